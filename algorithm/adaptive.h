@@ -0,0 +1,247 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "lamport.h"
+#include "token.h"
+#include "mutex.h"
+#include <mutex>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+extern Logger logger;
+
+// Chọn giữa LamportNode và TokenNode theo tải quan sát được. Mọi tin nhắn mang tiền tố "E<epoch>|":
+// epoch chẵn chạy Lamport, epoch lẻ chạy thẻ bài; tin nhắn của epoch cũ bị bỏ qua. Chỉ nút đang giữ vùng
+// găng được đổi giao thức: lúc nhả, thay vì RELEASE/chuyển thẻ nó phát SWITCH của epoch mới. Không nút nào
+// khác đang ở trong vùng găng, và không ai vào được theo epoch cũ nữa vì lượt của nút giữ không bao giờ
+// được nhả ở đó. Nút nhận SWITCH (hoặc bất kỳ tin nhắn nào của epoch mới hơn) bỏ trạng thái giao thức cũ,
+// yêu cầu đang chờ được xin lại theo giao thức mới.
+//
+// Thống kê đi theo lượt vào vùng găng (trong RELEASE của Lamport hoặc trong thẻ), nên nút giữ vùng găng
+// luôn thấy đủ lịch sử: số lượt trong epoch, tỉ lệ lượt do chính nút vừa dùng xong vào lại (trung bình
+// trượt) và nút vào gần nhất. Số tin nhắn cho một lượt: Lamport 3(N-1); thẻ bài N khi thẻ ở nút khác,
+// 0 khi vào lại. Chỉ đổi sang thẻ khi nó tiết kiệm phần lớn số tin nhắn, vì thẻ không có lease, journal
+// hay xử lý nút chết như Lamport; hai ngưỡng khác nhau và số lượt tối thiểu mỗi epoch tránh đổi qua lại.
+// Thẻ mất theo nút giữ nó thì không ai đổi về Lamport được (chỉ nút giữ vùng găng được đổi) và cả cụm đứng
+// yên, nên epoch thẻ chỉ được mở khi bật ADAPTIVE_TOKEN; mặc định AdaptiveMutex chỉ chạy Lamport.
+//
+// Giao thức không thuộc epoch hiện tại bị park(): lock() gọi sau khi epoch vừa đọc đã bị đổi trả về false
+// ngay, vòng lặp trong lock() đọc lại epoch và xin theo giao thức mới.
+class AdaptiveMutex : public DistributedMutex {
+private:
+    static constexpr int MIN_GRANTS = 64;           // Số lượt tối thiểu trong một epoch trước khi xét đổi
+    static constexpr int SMOOTHING = 32;            // Trung bình trượt trên khoảng 32 lượt gần nhất
+    static constexpr double TO_TOKEN = 0.25;        // Sang thẻ khi chi phí ước lượng của thẻ dưới 25% của Lamport
+    static constexpr double TO_LAMPORT = 0.375;     // Về Lamport khi vượt 37.5%
+    static constexpr int SCALE = 1000000;           // Tỉ lệ lưu dạng phần triệu
+
+    struct Stats {
+        int grants = 0;                             // Số lượt trong epoch hiện tại
+        int repeatShare = 0;                        // Tỉ lệ lượt vào lại, phần triệu
+        int last = 0;                               // Nút vào gần nhất
+    };
+
+    int id;
+    std::shared_ptr<Comm> comm;
+    std::unique_ptr<LamportNode> lamport;
+    std::unique_ptr<TokenNode> token;
+    std::mutex switchMutex;                         // Giữ khi đổi epoch và khi chuyển tin nhắn cho giao thức
+    int epoch = 0;
+    int heldEpoch = -1;                             // Epoch mà nút đang giữ vùng găng, -1 nếu không giữ
+    Stats held;                                     // Thống kê đã cập nhật với lượt đang giữ
+    std::string incomingBuffer;
+
+public:
+    AdaptiveMutex(int id, const std::string& ip, int port, std::shared_ptr<Comm> comm)
+        : id(id), comm(comm),
+          lamport(std::make_unique<LamportNode>(id, ip, port, comm, false)),
+          token(std::make_unique<TokenNode>(id, ip, port, comm, false)) {
+        token->park();
+        lamport->reset(prefix(epoch), "");
+        lamport->initialize();
+    }
+
+    bool lock(std::chrono::milliseconds timeout) override {
+        return lock(timeout, 0, std::chrono::milliseconds(0));
+    }
+
+    // Ưu tiên và hạn chót chỉ có tác dụng trong epoch Lamport
+    bool lock(std::chrono::milliseconds timeout, int priority, std::chrono::milliseconds deadline) override {
+        auto giveUp = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            int current;
+            {
+                std::lock_guard<std::mutex> lock(switchMutex);
+                current = epoch;
+            }
+            auto remaining = std::max(std::chrono::duration_cast<std::chrono::milliseconds>(giveUp - std::chrono::steady_clock::now()),
+                                      std::chrono::milliseconds(0));
+            bool entered = isLamport(current) ? lamport->lock(remaining, priority, deadline) : token->lock(remaining);
+
+            std::lock_guard<std::mutex> lock(switchMutex);
+            if (entered && current == epoch) {
+                heldEpoch = current;
+                held = update(parse(isLamport(current) ? lamport->getNote() : token->getNote()));
+                return true;
+            }
+            // Epoch đổi trong lúc chờ: trạng thái cũ đã bị bỏ, xin lại theo giao thức mới nếu còn thời gian
+            if (current == epoch || std::chrono::steady_clock::now() >= giveUp) {
+                return false;
+            }
+        }
+    }
+
+    void unlock() override {
+        std::lock_guard<std::mutex> lock(switchMutex);
+        if (heldEpoch != epoch) {
+            heldEpoch = -1;
+            return;
+        }
+        heldEpoch = -1;
+
+        // Ở Lamport chỉ đổi khi còn lease; parkIfHolding() kiểm tra và dừng giao thức cùng lúc
+        bool lamportMode = isLamport(epoch);
+        if (shouldSwitch(lamportMode) && (!lamportMode || lamport->parkIfHolding())) {
+            switchEpoch();
+            return;
+        }
+        if (lamportMode) {
+            lamport->setReleaseNote(format(held));
+            lamport->unlock();
+        }
+        else {
+            token->setNote(format(held));
+            token->unlock();
+        }
+    }
+
+    // Nhận một tin nhắn và chuyển cho giao thức của epoch hiện tại; trả về false khi Comm đã dừng
+    bool processMessage() override {
+        auto due = lamport->nextReplyDue();
+        bool running = (due == std::chrono::steady_clock::time_point::max()) ? comm->getMessage(incomingBuffer)
+                                                                             : comm->getMessage(incomingBuffer, due);
+        if (!running) {
+            return false;
+        }
+        if (incomingBuffer.empty()) {
+            lamport->flushReplies();
+            return true;
+        }
+
+        char* end;
+        long messageEpoch = incomingBuffer[0] == 'E' ? std::strtol(incomingBuffer.c_str() + 1, &end, 10) : -1;
+        if (messageEpoch < 0 || *end != '|') {
+            LOG_WARN("Node ", id, " ignored message without epoch: ", incomingBuffer);
+            return true;
+        }
+        size_t body = end + 1 - incomingBuffer.c_str();
+        bool isSwitch = incomingBuffer.compare(body, 7, "SWITCH ") == 0;
+
+        std::lock_guard<std::mutex> lock(switchMutex);
+        if (messageEpoch < epoch) {
+            return true;
+        }
+        if (messageEpoch > epoch) {
+            follow(messageEpoch, isSwitch ? incomingBuffer.substr(body + 7) : std::string());
+        }
+        if (isSwitch) {
+            return true;
+        }
+        incomingBuffer.erase(0, body);
+        if (isLamport(epoch)) lamport->handleMessage(incomingBuffer);
+        else token->handleMessage(incomingBuffer);
+        return true;
+    }
+
+    void shutdown() override {
+        lamport->shutdown();
+        token->shutdown();
+    }
+
+private:
+    static bool isLamport(int e) {
+        return e % 2 == 0;
+    }
+
+    static const char* protocolName(int e) {
+        return isLamport(e) ? "lamport" : "token";
+    }
+
+    static std::string prefix(int e) {
+        return "E" + std::to_string(e) + "|";
+    }
+
+    // "<số lượt> <tỉ lệ vào lại> <nút vào gần nhất>"; ghi chú rỗng hoặc lạ thì bắt đầu từ 0
+    static Stats parse(const std::string& note) {
+        Stats stats;
+        if (std::sscanf(note.c_str(), "%d %d %d", &stats.grants, &stats.repeatShare, &stats.last) != 3) {
+            return Stats();
+        }
+        return stats;
+    }
+
+    static std::string format(const Stats& stats) {
+        return std::to_string(stats.grants) + " " + std::to_string(stats.repeatShare) + " " + std::to_string(stats.last);
+    }
+
+    Stats update(Stats stats) const {
+        int repeat = (stats.last == id) ? SCALE : 0;
+        stats.repeatShare += (repeat - stats.repeatShare) / SMOOTHING;
+        stats.grants++;
+        stats.last = id;
+        return stats;
+    }
+
+    // Gọi khi đang giữ switchMutex, với thống kê của lượt vừa xong
+    bool shouldSwitch(bool lamportMode) const {
+        if (held.grants < MIN_GRANTS || (lamportMode && !config.useAdaptiveToken())) return false;
+        int n = config.getTotalNodes();
+        double lamportCost = 3.0 * (n - 1);
+        double tokenCost = (1.0 - static_cast<double>(held.repeatShare) / SCALE) * n;
+        return lamportMode ? tokenCost < TO_TOKEN * lamportCost : tokenCost > TO_LAMPORT * lamportCost;
+    }
+
+    // Nút giữ vùng găng mở epoch mới thay cho lần nhả; gọi khi đang giữ switchMutex
+    void switchEpoch() {
+        Stats next = held;
+        next.grants = 0;
+        std::string note = format(next);
+        epoch++;
+
+        LOG_INFO("Node ", id, " switched to ", protocolName(epoch), ", epoch ", epoch, ", repeat share ",
+                 static_cast<double>(held.repeatShare) / SCALE);
+        if (isLamport(epoch)) {
+            token->park();
+            lamport->reset(prefix(epoch), note);
+        }
+        else {
+            // Thẻ mới bắt đầu ở nút vừa nhả vùng găng
+            lamport->park();
+            token->reset(prefix(epoch), true, note);
+        }
+        try {
+            comm->broadcast(prefix(epoch) + "SWITCH " + note);
+        } catch (const std::exception& e) {
+            LOG_WARN("Broadcast failed: ", e.what());
+        }
+    }
+
+    // Theo epoch mới hơn mà nút khác đã mở; gọi khi đang giữ switchMutex
+    void follow(int newEpoch, const std::string& note) {
+        LOG_INFO("Node ", id, " follows switch to ", protocolName(newEpoch), ", epoch ", newEpoch);
+        epoch = newEpoch;
+        if (isLamport(epoch)) {
+            token->park();
+            lamport->reset(prefix(epoch), note);
+        }
+        else {
+            lamport->park();
+            token->reset(prefix(epoch), false, note);
+        }
+    }
+};
+
+#endif // ADAPTIVE_H
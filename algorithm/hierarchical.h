@@ -0,0 +1,427 @@
+#ifndef HIERARCHICAL_H
+#define HIERARCHICAL_H
+
+#include "lamport.h"
+#include "mutex.h"
+#include <mutex>
+#include <set>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <charconv>
+#include <algorithm>
+#include <condition_variable>
+
+extern Logger logger;
+
+// Loại trừ tương hỗ hai tầng theo nhóm của topology (group trong file TOPOLOGY): nút có id nhỏ nhất mỗi
+// nhóm là đại diện, chỉ các đại diện chạy LamportNode với nhau (tin nhắn có tiền tố "G|"). Thành viên xin
+// khóa ở đại diện của nhóm mình (tiền tố "L|"):
+//   "Id: 3, Type: LOCAL_REQUEST, Seq: 5"  thành viên -> đại diện
+//   "Id: 1, Type: LOCAL_GRANT, Seq: 5"    đại diện -> thành viên
+//   "Id: 3, Type: LOCAL_RELEASE, Seq: 5"  thành viên -> đại diện, nhả khóa hoặc rút yêu cầu đang chờ
+//   "Id: 1, Type: LOCAL_EXPIRED, Seq: 5"  đại diện -> thành viên, lease toàn cục đã hết, khóa bị lấy lại
+// Đại diện vào vùng găng toàn cục một lần rồi lần lượt cấp khóa cho tối đa LOCK_BATCH nút đang chờ trong
+// nhóm (kể cả chính nó) trước khi nhả, như lockDaemon. Mỗi lần vào chỉ tốn 3 tin nhắn trong nhóm; tin
+// nhắn giữa các nhóm là 3(G-1) cho cả một lượt của nhóm, G là số nhóm.
+// Lease của LamportNode tính cho cả lượt nên đại diện thôi cấp thêm khi lượt đã qua nửa lease. Lease hết
+// mà thành viên còn giữ khóa thì đại diện lấy lại khóa, báo LOCAL_EXPIRED và nhả vùng găng toàn cục như
+// lockDaemon; unlock() sau đó của thành viên không làm gì.
+// Đại diện chết thì thành viên của nhóm hết thời gian chờ, không có bầu lại đại diện.
+class HierarchicalMutex : public DistributedMutex {
+private:
+    struct Waiter {
+        int nodeId;
+        int seq;
+    };
+
+    int id;
+    std::shared_ptr<Comm> comm;
+    int representative;
+    std::unique_ptr<LamportNode> global;            // Chỉ có ở đại diện
+    std::mutex mutex;
+    std::condition_variable stateChanged;
+    std::string incomingBuffer;
+    int failureSubscription;
+    bool stopped = false;
+
+    // Phía thành viên (cả đại diện khi chính nó xin khóa)
+    int sequence = 0;
+    int waitingSeq = 0;                             // Lần xin đang chờ cấp, 0 nếu không có
+    int heldSeq = 0;                                // Lần xin đang giữ khóa, 0 nếu không giữ
+
+    // Phía đại diện
+    std::deque<Waiter> waiters;
+    Waiter holder = {0, 0};                         // Nút đang giữ khóa trong nhóm, nodeId 0 nếu không có
+    bool requested = false;                         // Yêu cầu toàn cục đang chờ
+    bool held = false;                              // Đại diện đang ở trong vùng găng toàn cục
+    int grantedInRound = 0;
+    std::chrono::steady_clock::time_point roundStart;
+    // Nút giữ khóa bị nghi ngờ đã chết: chỉ cấp lại khóa từ lúc này
+    std::chrono::steady_clock::time_point reclaimAt = std::chrono::steady_clock::time_point::max();
+    bool watcherRunning = true;
+    std::thread watcher;                            // Chờ vùng găng toàn cục thay cho luồng nhận tin
+
+public:
+    HierarchicalMutex(int id, const std::string& ip, int port, std::shared_ptr<Comm> comm)
+        : id(id), comm(comm), representative(representativeOf(config.getNodeGroup(id))) {
+        FailureDetector::Listener listener;
+        listener.onSuspect = [this](int nodeId) { handleNodeFailure(nodeId); };
+        listener.onTick = [this] { reclaimExpired(); };
+        failureSubscription = comm->subscribe(listener);
+
+        if (isRepresentative()) {
+            // Các nút xếp theo id: nút đầu tiên gặp của mỗi nhóm là đại diện
+            std::vector<int> representatives;
+            std::set<int> seen;
+            for (const NodeInfo& node : config.getNodes()) {
+                if (seen.insert(node.group).second) representatives.push_back(node.id);
+            }
+            global = std::make_unique<LamportNode>(id, ip, port, comm, false);
+            global->reset(GLOBAL_PREFIX, "");
+            global->setPeers(representatives);
+            global->initialize();
+            watcher = std::thread(&HierarchicalMutex::watchCriticalSection, this);
+            LOG_INFO("Node ", id, " represents group ", config.getGroupName(config.getNodeGroup(id)),
+                     " among ", representatives.size(), " groups");
+        }
+    }
+
+    ~HierarchicalMutex() {
+        comm->unsubscribe(failureSubscription);
+        if (watcher.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                watcherRunning = false;
+            }
+            stateChanged.notify_all();
+            watcher.join();
+        }
+    }
+
+    bool lock(std::chrono::milliseconds timeout) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopped) return false;
+        int seq = ++sequence;
+        waitingSeq = seq;
+        if (isRepresentative()) {
+            waiters.push_back({id, seq});
+            schedule();
+        }
+        else if (!sendLocal(representative, "LOCAL_REQUEST", seq)) {
+            waitingSeq = 0;
+            return false;
+        }
+
+        stateChanged.wait_for(lock, timeout, [&] { return stopped || heldSeq == seq; });
+        waitingSeq = 0;
+        if (stopped) return false;
+        if (heldSeq == seq) {
+            LOG_INFO("Node ", id, " holds group lock, Seq: ", seq);
+            return true;
+        }
+        // Rút yêu cầu; khóa được cấp sau đó thì được trả lại ngay lúc nhận
+        returnLock(seq);
+        return false;
+    }
+
+    void unlock() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (heldSeq == 0) return;
+        LOG_INFO("Node ", id, " returns group lock, Seq: ", heldSeq);
+        returnLock(heldSeq);
+        heldSeq = 0;
+    }
+
+    // Nhận một tin nhắn và chuyển cho tầng tương ứng; trả về false khi Comm đã dừng
+    bool processMessage() override {
+        auto due = global ? global->nextReplyDue() : std::chrono::steady_clock::time_point::max();
+        bool running = (due == std::chrono::steady_clock::time_point::max()) ? comm->getMessage(incomingBuffer)
+                                                                             : comm->getMessage(incomingBuffer, due);
+        if (!running) {
+            return false;
+        }
+        if (incomingBuffer.empty()) {
+            if (global) global->flushReplies();
+            return true;
+        }
+
+        if (incomingBuffer.compare(0, 2, GLOBAL_PREFIX) == 0 && global) {
+            incomingBuffer.erase(0, 2);
+            global->handleMessage(incomingBuffer);
+        }
+        else if (incomingBuffer.compare(0, 2, LOCAL_PREFIX) == 0) {
+            handleLocalMessage(incomingBuffer.c_str() + 2);
+        }
+        else {
+            LOG_WARN("Node ", id, " ignored message: ", incomingBuffer);
+        }
+        return true;
+    }
+
+    // Thành viên trả khóa hoặc rút yêu cầu. Đại diện không cấp thêm, chờ thành viên đang giữ khóa trả lại
+    // (tối đa tới hết lease của lượt, hoặc tới khi nó bị nghi ngờ đã chết) rồi mới nhả hoặc rút yêu cầu toàn
+    // cục, để nhóm khác không vào khi thành viên vẫn còn trong vùng găng. Không có lease lẫn bộ phát hiện lỗi
+    // (TIMEOUT = 0) thì chỉ còn cách chờ thành viên trả. Thành viên đang chờ sẽ hết thời gian chờ.
+    // Luồng nhận tin phải còn chạy trong lúc gọi
+    void shutdown() override {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (stopped) return;
+            stopped = true;
+            int seq = heldSeq ? heldSeq : waitingSeq;
+            heldSeq = waitingSeq = 0;
+            if (seq && !isRepresentative()) sendLocal(representative, "LOCAL_RELEASE", seq);
+            waiters.clear();
+            if (holder.nodeId == id) holder = {0, 0};
+            stateChanged.notify_all();
+
+            if (holder.nodeId != 0) {
+                LOG_INFO("Node ", id, " waits for node ", holder.nodeId, " to return group lock before stopping");
+                // Xét lại nghi ngờ mỗi chu kỳ: onSuspect chỉ báo lúc nút mới bị nghi ngờ
+                auto returned = [this] { return holder.nodeId == 0 || comm->isSuspected(holder.nodeId); };
+                auto until = (config.getLeaseTime() > 0) ? roundStart + std::chrono::milliseconds(config.getLeaseTime())
+                                                         : std::chrono::steady_clock::time_point::max();
+                auto poll = std::chrono::milliseconds(std::max(config.getTimeout(), 100));
+                while (!returned() && std::chrono::steady_clock::now() < until) {
+                    stateChanged.wait_until(lock, std::min(until, std::chrono::steady_clock::now() + poll), returned);
+                }
+            }
+            holder = {0, 0};
+            held = requested = false;
+        }
+        stateChanged.notify_all();
+        if (global) global->shutdown();
+    }
+
+private:
+    inline static const std::string GLOBAL_PREFIX = "G|";
+    inline static const std::string LOCAL_PREFIX = "L|";
+
+    static int representativeOf(int group) {
+        for (const NodeInfo& node : config.getNodes()) {
+            if (node.group == group) return node.id;
+        }
+        throw std::runtime_error("Group " + std::to_string(group) + " has no nodes");
+    }
+
+    bool isRepresentative() const {
+        return representative == id;
+    }
+
+    // Gọi khi đang giữ mutex
+    void returnLock(int seq) {
+        if (isRepresentative()) {
+            releaseLocal(id, seq);
+        }
+        else {
+            sendLocal(representative, "LOCAL_RELEASE", seq);
+        }
+    }
+
+    // "Id: 3, Type: LOCAL_REQUEST, Seq: 5"
+    void handleLocalMessage(const char* text) {
+        char* end;
+        if (strncmp(text, "Id: ", 4) != 0) return warnMalformed(text);
+        int senderId = std::strtol(text + 4, &end, 10);
+        if (strncmp(end, ", Type: ", 8) != 0) return warnMalformed(text);
+        const char* type = end + 8;
+        const char* seqText = strstr(type, ", Seq: ");
+        if (!seqText) return warnMalformed(text);
+        int seq = std::strtol(seqText + 7, &end, 10);
+        size_t typeLength = seqText - type;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (typeLength == 13 && strncmp(type, "LOCAL_REQUEST", 13) == 0 && isRepresentative()) {
+            if (stopped) return;
+            // Mỗi nút chờ nhiều nhất một lần xin: lần mới thay lần cũ
+            dropWaiter(senderId);
+            waiters.push_back({senderId, seq});
+            schedule();
+        }
+        else if (typeLength == 13 && strncmp(type, "LOCAL_RELEASE", 13) == 0 && isRepresentative()) {
+            releaseLocal(senderId, seq);
+        }
+        else if (typeLength == 11 && strncmp(type, "LOCAL_GRANT", 11) == 0) {
+            granted(seq);
+        }
+        else if (typeLength == 13 && strncmp(type, "LOCAL_EXPIRED", 13) == 0) {
+            expired(seq);
+        }
+        else {
+            warnMalformed(text);
+        }
+    }
+
+    void warnMalformed(const char* text) {
+        LOG_WARN("Node ", id, " ignored malformed message: ", text);
+    }
+
+    // Khóa của nhóm tới nút này; lần xin đã thôi chờ thì trả lại ngay. Gọi khi đang giữ mutex
+    void granted(int seq) {
+        if (seq == waitingSeq) {
+            heldSeq = seq;
+            stateChanged.notify_all();
+        }
+        else if (seq != heldSeq) {
+            returnLock(seq);
+        }
+    }
+
+    // Đại diện đã lấy lại khóa khi hết lease toàn cục: không còn gì để trả. Gọi khi đang giữ mutex
+    void expired(int seq) {
+        if (seq != heldSeq) return;
+        LOG_WARN("Node ", id, " lost group lock, global lease expired, Seq: ", seq);
+        heldSeq = 0;
+    }
+
+    // Phía đại diện, gọi khi đang giữ mutex: trả khóa đang giữ hoặc rút yêu cầu đang chờ
+    void releaseLocal(int nodeId, int seq) {
+        if (holder.nodeId == nodeId && holder.seq == seq) {
+            holder = {0, 0};
+            schedule();
+            stateChanged.notify_all();
+            return;
+        }
+        waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                     [&](const Waiter& waiter) { return waiter.nodeId == nodeId && waiter.seq == seq; }),
+                      waiters.end());
+    }
+
+    void dropWaiter(int nodeId) {
+        waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                     [nodeId](const Waiter& waiter) { return waiter.nodeId == nodeId; }),
+                      waiters.end());
+    }
+
+    // Cấp khóa cho nút kế tiếp nếu đại diện đang ở trong vùng găng toàn cục, nếu không thì xin vào.
+    // Gọi khi đang giữ mutex
+    void schedule() {
+        if (holder.nodeId != 0 || stopped) return;
+
+        if (held) {
+            // Chỉ cấp thêm khi lease còn đủ cho nút mới
+            bool leaseLeft = global->holdsLease() &&
+                             (config.getLeaseTime() <= 0 ||
+                              std::chrono::steady_clock::now() - roundStart < std::chrono::milliseconds(config.getLeaseTime() / 2));
+            if (!waiters.empty() && grantedInRound < config.getLockBatch() && leaseLeft) {
+                holder = waiters.front();
+                waiters.pop_front();
+                reclaimAt = std::chrono::steady_clock::time_point::max();
+                grantedInRound++;
+                if (holder.nodeId == id) granted(holder.seq);
+                else if (!sendLocal(holder.nodeId, "LOCAL_GRANT", holder.seq)) holder = {0, 0};
+                if (holder.nodeId == 0) schedule();
+                return;
+            }
+            global->releaseCriticalSection();
+            held = false;
+        }
+
+        if (!waiters.empty() && !requested) {
+            requested = true;
+            global->requestCriticalSection();
+            stateChanged.notify_all();
+        }
+    }
+
+    // Luồng riêng của đại diện: chờ vào vùng găng toàn cục cho yêu cầu đang chờ
+    void watchCriticalSection() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            stateChanged.wait(lock, [this] { return (requested && !held) || !watcherRunning; });
+            if (!watcherRunning) break;
+            lock.unlock();
+            bool entered = global->waitForCriticalSection(std::chrono::seconds(1));
+            lock.lock();
+            if (entered && requested && !stopped) {
+                requested = false;
+                held = true;
+                grantedInRound = 0;
+                roundStart = std::chrono::steady_clock::now();
+                global->enterCriticalSection();
+                // Mọi nút đang chờ đã rút yêu cầu: schedule() nhả vùng găng ngay
+                schedule();
+            }
+        }
+    }
+
+    // Thành viên chết khi đang giữ hoặc đang chờ khóa của nhóm. Nút bị nghi ngờ nhầm có thể vẫn ở trong
+    // vùng găng, nên như shutdown() khóa chỉ được lấy lại khi hết lease của lượt (không có lease thì lấy ngay)
+    void handleNodeFailure(int nodeId) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!isRepresentative()) return;
+            dropWaiter(nodeId);
+            if (holder.nodeId != nodeId) return;
+            reclaimAt = (config.getLeaseTime() > 0) ? roundStart + std::chrono::milliseconds(config.getLeaseTime())
+                                                    : std::chrono::steady_clock::now();
+            LOG_WARN("Node ", id, " will reclaim group lock from failed node ", nodeId, " when the round's lease ends");
+        }
+        reclaimExpired();
+    }
+
+    // Gọi mỗi chu kỳ heartbeat: lấy lại khóa khi lease toàn cục đã hết, hoặc cấp lại khóa của nút giữ bị
+    // nghi ngờ khi đã tới reclaimAt
+    void reclaimExpired() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (held && !global->holdsLease()) {
+            expireRound();
+            return;
+        }
+        if (holder.nodeId == 0 || std::chrono::steady_clock::now() < reclaimAt) return;
+        LOG_WARN("Node ", id, " reclaimed group lock from failed node ", holder.nodeId);
+        holder = {0, 0};
+        reclaimAt = std::chrono::steady_clock::time_point::max();
+        schedule();
+        stateChanged.notify_all();
+    }
+
+    // LamportNode đã (hoặc sắp) tự nhả vùng găng toàn cục: nhóm khác có thể vào, báo cho nút đang giữ khóa.
+    // Gọi khi đang giữ mutex
+    void expireRound() {
+        if (holder.nodeId != 0) {
+            LOG_WARN("Node ", id, " global lease expired while node ", holder.nodeId, " held group lock");
+            if (holder.nodeId == id) expired(holder.seq);
+            else sendLocal(holder.nodeId, "LOCAL_EXPIRED", holder.seq);
+            holder = {0, 0};
+        }
+        reclaimAt = std::chrono::steady_clock::time_point::max();
+        global->releaseCriticalSection();
+        held = false;
+        schedule();
+        stateChanged.notify_all();
+    }
+
+    // Gọi khi đang giữ mutex; false nếu gửi không được
+    bool sendLocal(int receiverId, const char* type, int seq) {
+        std::string message = LOCAL_PREFIX;
+        message += "Id: ";
+        appendNumber(message, id);
+        message += ", Type: ";
+        message += type;
+        message += ", Seq: ";
+        appendNumber(message, seq);
+        try {
+            comm->send(receiverId, message);
+        } catch (const std::exception& e) {
+            LOG_WARN("Send to node ", receiverId, " failed: ", e.what());
+            return false;
+        }
+        LOG_DEBUG(message.c_str() + LOCAL_PREFIX.size(), ", To: ", receiverId);
+        return true;
+    }
+
+    static void appendNumber(std::string& out, int value) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr - digits);
+    }
+};
+
+#endif // HIERARCHICAL_H
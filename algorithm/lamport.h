@@ -3,13 +3,20 @@
 
 #include "node.h"
 #include "log.h"
+#include "journal.h"
+#include "mutex.h"
 #include <atomic>
 #include <mutex>
-#include <queue>
+#include <cstring>
+#include <cstdlib>
+#include <charconv>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
+#include <chrono>
 #include <algorithm>
+#include <condition_variable>
 
 extern Logger logger;
 
@@ -20,24 +27,92 @@ struct Message {
     int timestamp;           // Dấu thời gian của tin nhắn
     MessageType type;        // Loại tin nhắn (REQUEST, REPLY, hoặc RELEASE)
     std::string content;     // Nội dung tin nhắn
+    int priority = 0;        // Bậc ưu tiên của REQUEST, từ 0 tới LamportNode::MAX_PRIORITY
 };
 
-class LamportNode : public Node {
+class LamportNode : public Node, public DistributedMutex {
+public:
+    static constexpr int MAX_PRIORITY = 3;
+
 private:
+    // REPLY cho yêu cầu ưu tiên thấp được giữ lại trong thời gian ân hạn để yêu cầu ưu tiên cao
+    // phát sau vẫn xếp trước được; gửi khi đồng hồ đã qua ngưỡng hoặc hết ân hạn
+    struct DeferredReply {
+        int senderId;
+        int threshold;                                  // Dấu thời gian REPLY tối thiểu
+        std::chrono::steady_clock::time_point due;
+    };
+
     std::atomic<int> lamportTimestamp;  // Đồng hồ logic của Lamport
-    std::priority_queue<Message, std::vector<Message>, bool(*)(const Message&, const Message&)> requestQueue; // Hàng đợi yêu cầu
+    std::vector<Message> requestQueue;  // Hàng đợi yêu cầu: heap theo compareMessages, phần tử đầu là yêu cầu sớm nhất
     std::mutex queueMutex;  
-    std::map<int, bool> replyReceived;  // Theo dõi trạng thái nhận REPLY từ các nút khác
+    std::condition_variable stateChanged;   // Báo khi nhận REPLY/RELEASE hoặc có nút bị loại
+    std::vector<char> replyReceived;    // Theo dõi trạng thái nhận REPLY từ các nút khác, đánh chỉ số theo id
+    std::string incomingBuffer;         // Vùng đệm và tin nhắn nhận được dùng lại cho mọi tin nhắn
+    Message incoming;
+    std::set<int> failedNodes;          // Các nút đang bị nghi ngờ đã chết
+    std::map<int, std::chrono::steady_clock::time_point> fencedUntil;  // Yêu cầu của nút bị nghi ngờ giữ tới lúc này
+    int failureSubscription;
+    std::unique_ptr<Journal> journal;   // Ghi đồng hồ và hàng đợi để khởi động lại nhanh (nếu có JOURNAL_DIR)
+
+    // Quyền vào vùng găng là một lease: hết hạn thì tự nhả, nút khác loại yêu cầu giữ quá lâu
+    bool inCriticalSection = false;
+    bool leaseLost = false;                             // Lease đã hết và vùng găng đã được tự nhả
+    std::chrono::steady_clock::time_point leaseExpiry;
+    std::pair<int, int> head = {-1, -1};                // (senderId, timestamp) của yêu cầu đầu hàng đợi
+    std::chrono::steady_clock::time_point headSince;
+    bool stopped = false;                               // Đã gọi shutdown(): không xin vào vùng găng nữa
+    bool parked = false;                                // Đã gọi park(): không xin vào vùng găng cho tới reset() sau
+    int replyThreshold = 0;                             // REPLY có dấu thời gian nhỏ hơn không tính cho yêu cầu hiện tại
+    int ownPriority = 0;                                // Bậc ưu tiên của lần xin gần nhất của nút này
+    std::vector<DeferredReply> deferredReplies;
+    std::string channel;                                // Tiền tố của mọi tin nhắn gửi đi (AdaptiveMutex dùng cho epoch)
+    std::vector<int> peers;                             // Các nút cùng chạy giao thức; rỗng là mọi nút khác
+    bool restricted = false;                            // Đã gọi setPeers()
+    std::string releaseNote;                            // Ghi chú gửi kèm RELEASE tiếp theo của nút này
+    std::string latestNote;                             // Ghi chú của RELEASE có dấu thời gian lớn nhất đã nhận
+    int latestNoteTimestamp = 0;
+
+    // Khóa sắp xếp: mỗi bậc ưu tiên được tính sớm hơn PRIORITY_STEP nhịp đồng hồ
+    static long long orderKey(const Message& msg) {
+        return static_cast<long long>(msg.timestamp) - static_cast<long long>(config.getPriorityStep()) * msg.priority;
+    }
+
+    // Ngưỡng dấu thời gian của REPLY cho một yêu cầu: sau REPLY đó, mọi yêu cầu mới của nút trả lời
+    // (dù ưu tiên cao nhất) đều có khóa lớn hơn nên không thể vượt yêu cầu đã được vào vùng găng
+    static int thresholdOf(const Message& msg) {
+        return msg.timestamp + config.getPriorityStep() * (MAX_PRIORITY - msg.priority);
+    }
 
     static bool compareMessages(const Message &m1, const Message &m2) {
-        // So sánh các tin nhắn theo dấu thời gian và ID của nút
-        return (m1.timestamp > m2.timestamp) || 
-               (m1.timestamp == m2.timestamp && m1.senderId > m2.senderId);
+        // So sánh các tin nhắn theo khóa (dấu thời gian trừ phần ưu tiên) và ID của nút
+        long long k1 = orderKey(m1), k2 = orderKey(m2);
+        return (k1 > k2) || (k1 == k2 && m1.senderId > m2.senderId);
     }
 
 public:
-    LamportNode(int id, const std::string& ip, int port, std::shared_ptr<Comm> comm)
-        : Node(id, ip, port, comm), lamportTimestamp(0), requestQueue(compareMessages) {}
+    // journaled = false khi hàng đợi không được khôi phục sau khởi động lại (vd giao thức do AdaptiveMutex
+    // bật tắt theo epoch)
+    LamportNode(int id, const std::string& ip, int port, std::shared_ptr<Comm> comm, bool journaled = true)
+        : Node(id, ip, port, comm), lamportTimestamp(0), replyReceived(config.getTotalNodes() + 1, 1) {
+        // Mỗi nút có nhiều nhất một yêu cầu đang chờ nên hàng đợi không phải cấp phát thêm
+        requestQueue.reserve(config.getTotalNodes() + 1);
+
+        FailureDetector::Listener listener;
+        listener.onSuspect = [this](int nodeId) { handleNodeFailure(nodeId); };
+        listener.onRecover = [this](int nodeId) { handleNodeRecovery(nodeId); };
+        listener.onTick = [this] { checkLeases(); };
+        failureSubscription = comm->subscribe(listener);
+
+        if (journaled && !config.getJournalDir().empty()) {
+            journal = std::make_unique<Journal>(config.getJournalDir() + "/lamport_" + std::to_string(id) + ".journal");
+            recover();
+        }
+    }
+
+    ~LamportNode() {
+        comm->unsubscribe(failureSubscription);
+    }
 
     int getTimestamp() const {
         return lamportTimestamp.load();
@@ -48,149 +123,653 @@ public:
         incrementTimestamp();
         int currentTimestamp = getTimestamp();
         
-        Message msg = {id, currentTimestamp, type, content};
-        std::string messageContent = formatLamportMessage(msg);
+        const std::string& messageContent = formatLamportMessage({id, currentTimestamp, type, content});
         
-        comm->send(receiverId, messageContent);
-        logger.log(messageContent);
+        try {
+            if (channel.empty()) comm->send(receiverId, messageContent);
+            else comm->send(receiverId, channel + messageContent);
+        } catch (const std::exception& e) {
+            // Nút nhận đã chết: bộ phát hiện lỗi sẽ loại nó sau TIMEOUT
+            LOG_WARN("Send to node ", receiverId, " failed: ", e.what());
+            return;
+        }
+        LOG_DEBUG(messageContent, ", To: ", receiverId);
+    }
+
+    // Phát tin nhắn tới tất cả các nút khác trong một đợt gửi, mọi nút nhận cùng một dấu thời gian
+    void broadcastLamportMessage(const Message& msg) {
+        const std::string& messageContent = formatLamportMessage(msg);
+
+        try {
+            if (restricted) comm->multicast(peers, channel + messageContent);
+            else if (channel.empty()) comm->broadcast(messageContent);
+            else comm->broadcast(channel + messageContent);
+        } catch (const std::exception& e) {
+            LOG_WARN("Broadcast failed: ", e.what());
+        }
+        if (logger.isEnabled(LogLevel::Debug)) {
+            for (const NodeInfo& node : config.getNodes()) {
+                if (node.id != id && !comm->isSuspected(node.id) && isPeer(node.id)) {
+                    LOG_DEBUG(messageContent, ", To: ", node.id);
+                }
+            }
+        }
     }
 
-    // Xử lý tin nhắn Lamport nhận được, cập nhật đồng hồ và hàng đợi
-    void receiveLamportMessage() {
-        std::string messageContent = comm->getMessage();
-        Message msg = parseMessage(messageContent);
+    // Chỉ chạy giao thức với các nút này (vd đại diện các nhóm trong HierarchicalMutex): REQUEST và
+    // RELEASE chỉ gửi tới chúng, không chờ REPLY của nút khác. Gọi trước lần xin đầu tiên
+    void setPeers(const std::vector<int>& nodeIds) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        peers.clear();
+        for (int nodeId : nodeIds) {
+            if (nodeId != id) peers.push_back(nodeId);
+        }
+        restricted = true;
+    }
+
+    // Nhận và xử lý một tin nhắn Lamport; chỉ gọi từ một luồng. Khi có REPLY đang giữ lại thì chỉ chờ
+    // tới hạn của nó. Trả về false khi Comm đã dừng
+    bool receiveLamportMessage() {
+        auto due = nextReplyDue();
+        bool running = (due == std::chrono::steady_clock::time_point::max()) ? comm->getMessage(incomingBuffer)
+                                                                             : comm->getMessage(incomingBuffer, due);
+        if (!running) {
+            return false;
+        }
+        if (incomingBuffer.empty()) {
+            flushReplies();
+        }
+        else {
+            handleMessage(incomingBuffer);
+        }
+        return true;
+    }
+
+    // Xử lý tin nhắn đã nhận (không có tiền tố channel), cập nhật đồng hồ và hàng đợi; chỉ gọi từ luồng nhận
+    void handleMessage(const std::string& text) {
+        if (!parseMessage(text, incoming)) {
+            LOG_WARN("Node ", id, " ignored malformed message: ", text);
+            return;
+        }
+        const Message& msg = incoming;
         int senderTimestamp = msg.timestamp;
         int senderId = msg.senderId;
 
         // Cập nhật đồng hồ Lamport thành max(đồng hồ hiện tại, dấu thời gian nhận được) + 1
         incrementTimestamp();
         lamportTimestamp.store(std::max(lamportTimestamp.load(), senderTimestamp) + 1);
+        writeJournal([&](Journal& j) { j.observeClock(getTimestamp()); });
 
         std::lock_guard<std::mutex> lock(queueMutex);
         switch (msg.type) {
             case REQUEST:
-                // Thêm yêu cầu vào hàng đợi và gửi REPLY
-                requestQueue.push(msg);
-                sendLamportMessage(senderId, REPLY, "OK");
+                // Thêm yêu cầu vào hàng đợi và gửi REPLY; yêu cầu ưu tiên thấp chờ tới ngưỡng hoặc hết ân hạn
+                pushRequest(msg);
+                deferReply(msg);
                 break;
                 
             case REPLY:
-                // Đánh dấu đã nhận REPLY từ nút này
-                replyReceived[senderId] = true;
+                // Đánh dấu đã nhận REPLY từ nút này; REPLY cũ của yêu cầu đã rút không đủ ngưỡng
+                if (senderId > 0 && senderId < (int)replyReceived.size() && senderTimestamp >= replyThreshold) {
+                    replyReceived[senderId] = true;
+                }
                 break;
 
             case RELEASE:
                 // Xoá yêu cầu của nút gửi tin nhắn khỏi hàng đợi
                 removeRequest(senderId);
+                if (senderTimestamp > latestNoteTimestamp && msg.content != "Release CS") {
+                    latestNote = msg.content;
+                    latestNoteTimestamp = senderTimestamp;
+                }
                 break;
         }
+        sendDueReplies(std::chrono::steady_clock::now());
+        stateChanged.notify_all();
+    }
+
+    // Hạn của REPLY đang giữ lại sớm nhất, time_point::max() nếu không có; luồng nhận chờ tin nhắn tới
+    // thời điểm này rồi gọi flushReplies()
+    std::chrono::steady_clock::time_point nextReplyDue() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        auto due = std::chrono::steady_clock::time_point::max();
+        for (const DeferredReply& reply : deferredReplies) {
+            due = std::min(due, reply.due);
+        }
+        return due;
     }
 
-    // Khởi tạo yêu cầu vào vùng găng (critical section)
-    void requestCriticalSection() {
+    void flushReplies() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        sendDueReplies(std::chrono::steady_clock::now());
+    }
+
+    // Khởi tạo yêu cầu vào vùng găng (critical section) với bậc ưu tiên 0..MAX_PRIORITY
+    void requestCriticalSection(int priority = 0) {
+        // Lấy dấu thời gian và phát REQUEST trong cùng một lần giữ queueMutex: REPLY do luồng nhận gửi
+        // sau đó không thể tới các nút khác trước REQUEST mang dấu thời gian cũ hơn nó
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopped || parked) return;
         incrementTimestamp();
-        int currentTimestamp = getTimestamp();
+        Message request = {id, getTimestamp(), REQUEST, "Request CS", std::clamp(priority, 0, MAX_PRIORITY)};
+        pushRequest(request);
+        resetReplies();
+        replyThreshold = thresholdOf(request);
+        ownPriority = request.priority;
+
+        // Phát đi tin nhắn REQUEST đến tất cả các nút khác, cùng dấu thời gian với yêu cầu trong hàng đợi
+        broadcastLamportMessage(request);
+        sendDueReplies(std::chrono::steady_clock::now());
+    }
+
+    // Kiểm tra nếu nút có thể vào vùng găng hay không
+    bool canEnterCriticalSection() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return canEnter();
+    }
 
-        // Thêm yêu cầu của nút vào hàng đợi
+    // Chờ tối đa timeout cho tới khi vào được vùng găng; nút chết không làm chờ mãi, shutdown() hoặc
+    // reset() (yêu cầu không còn trong hàng đợi) làm dừng chờ ngay
+    bool waitForCriticalSection(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        stateChanged.wait_for(lock, timeout, [this] { return stopped || !hasOwnRequest() || canEnter(); });
+        return !stopped && canEnter();
+    }
+
+    void enterCriticalSection() {
         {
             std::lock_guard<std::mutex> lock(queueMutex);
-            Message request = {id, currentTimestamp, REQUEST, "Requesting CS"};
-            requestQueue.push(request);
-            resetReplies();
+            inCriticalSection = true;
+            leaseLost = false;
+            leaseExpiry = (config.getLeaseTime() > 0)
+                ? std::chrono::steady_clock::now() + std::chrono::milliseconds(config.getLeaseTime())
+                : std::chrono::steady_clock::time_point::max();
         }
+        LOG_INFO("Node ", id, " enter CS, Timestamp: ", getTimestamp());
+    }
 
-        // Phát đi tin nhắn REQUEST đến tất cả các nút khác
-        for (const auto& node : config.getNodeConfigs()) {
-            if (node.first != id) {
-                sendLamportMessage(node.first, REQUEST, "Request CS");
-            }
-        }
+    // Nút giữ vùng găng phải kiểm tra trước khi làm tiếp: hết lease thì đã bị nhả
+    bool holdsLease() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return inCriticalSection && std::chrono::steady_clock::now() < leaseExpiry;
     }
 
-    // Kiểm tra nếu nút có thể vào vùng găng hay không
-    bool canEnterCriticalSection() {
+    // Yêu cầu của nút còn trong hàng đợi; reset() hoặc rút yêu cầu làm nó mất mà không vào vùng găng
+    bool isRequesting() {
         std::lock_guard<std::mutex> lock(queueMutex);
-        
-        // Điều kiện để vào vùng găng
-        return std::all_of(replyReceived.begin(), replyReceived.end(), 
-                [](const std::pair<int, bool>& entry) { return entry.second; }) &&
-                !requestQueue.empty() && requestQueue.top().senderId == id;
+        return hasOwnRequest();
     }
 
-    void enterCriticalSection() {
-        logger.log("Node " + std::to_string(id) + " enter CS");
+    // Sau shutdown() mọi lần chờ vùng găng trả về false ngay
+    bool isStopped() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return stopped;
     }
 
     // Thoát khỏi vùng găng và thông báo cho các nút khác
     void releaseCriticalSection() {
+        release(false);
+    }
+
+    // Gọi khi tiến trình dừng: nhả vùng găng đang giữ hoặc rút yêu cầu đang chờ để các nút khác
+    // không phải đợi bộ phát hiện lỗi, rồi đánh thức mọi luồng đang chờ vùng găng
+    void shutdown() override {
+        bool pending;
         {
             std::lock_guard<std::mutex> lock(queueMutex);
-            // Xóa yêu cầu của nút khỏi hàng đợi
-            if (!requestQueue.empty() && requestQueue.top().senderId == id) {
-                requestQueue.pop();
-            }
+            if (stopped) return;
+            stopped = true;
+            pending = withdrawRequest();
+            inCriticalSection = false;
+        }
+        stateChanged.notify_all();
+
+        if (pending) {
+            LOG_INFO("Node ", id, " withdrew its request on shutdown, Timestamp: ", getTimestamp());
+            std::lock_guard<std::mutex> lock(queueMutex);
+            incrementTimestamp();
+            broadcastLamportMessage({id, getTimestamp(), RELEASE, "Release CS"});
         }
+    }
+
+    // Ghi chú (vd thống kê) gửi kèm RELEASE kế tiếp; nút vào vùng găng sau đọc lại bằng getNote()
+    void setReleaseNote(const std::string& note) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        releaseNote = note;
+    }
 
-        // Phát đi tin nhắn RELEASE đến tất cả các nút khác
-        for (const auto& node : config.getNodeConfigs()) {
-            if (node.first != id) {
-                sendLamportMessage(node.first, RELEASE, "Release CS");
+    // Ghi chú của lần nhả gần nhất theo đồng hồ Lamport, tức của nút giữ vùng găng ngay trước
+    std::string getNote() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        return latestNote;
+    }
+
+    // Bỏ toàn bộ trạng thái giao thức (hàng đợi, REPLY đang chờ và đang giữ) mà không gửi gì, rồi gửi
+    // các tin nhắn sau với tiền tố mới; đồng hồ giữ nguyên. Luồng đang chờ vùng găng được đánh thức
+    void reset(const std::string& prefix, const std::string& note) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            clearState();
+            parked = false;
+            channel = prefix;
+            latestNote = note;
+        }
+        stateChanged.notify_all();
+    }
+
+    // Như reset() nhưng giữ tiền tố cũ và không nhận yêu cầu mới cho tới reset() sau: lock() gọi trễ,
+    // sau khi AdaptiveMutex đã đổi giao thức, trả về false ngay thay vì phát REQUEST mà không nút nào nghe
+    void park() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            clearState();
+            parked = true;
+            latestNote.clear();
+        }
+        stateChanged.notify_all();
+    }
+
+    // Như park() nhưng chỉ khi nút còn giữ lease, kiểm tra và dừng trong cùng một lần giữ queueMutex nên
+    // checkLeases() không thể nhả vùng găng xen giữa; trả về false (không làm gì) nếu lease đã mất
+    bool parkIfHolding() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (!inCriticalSection || std::chrono::steady_clock::now() >= leaseExpiry) return false;
+            clearState();
+            parked = true;
+            latestNote.clear();
+        }
+        stateChanged.notify_all();
+        return true;
+    }
+
+    // DistributedMutex: xin, chờ, vào vùng găng; hết thời gian thì rút yêu cầu để lần sau không bị trùng
+    bool lock(std::chrono::milliseconds timeout) override {
+        return lock(timeout, 0, std::chrono::milliseconds(0));
+    }
+
+    // Hạn chót chỉ xét tại nút xin, không nằm trong khóa sắp xếp: qua nửa hạn mà chưa vào được thì
+    // rút yêu cầu và xin lại ở bậc cao nhất (chỉ có tác dụng khi PRIORITY_STEP > 0)
+    bool lock(std::chrono::milliseconds timeout, int priority, std::chrono::milliseconds deadline) override {
+        auto giveUp = std::chrono::steady_clock::now() + timeout;
+        requestCriticalSection(priority);
+
+        if (deadline.count() > 0 && priority < MAX_PRIORITY && config.getPriorityStep() > 0 && deadline / 2 < timeout) {
+            if (waitForCriticalSection(deadline / 2)) {
+                enterCriticalSection();
+                return true;
+            }
+            if (withdraw()) {
+                LOG_DEBUG("Node ", id, " escalated its request to priority ", MAX_PRIORITY, ", Timestamp: ", getTimestamp());
+                requestCriticalSection(MAX_PRIORITY);
             }
         }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(giveUp - std::chrono::steady_clock::now());
+        if (waitForCriticalSection(std::max(remaining, std::chrono::milliseconds(0)))) {
+            enterCriticalSection();
+            return true;
+        }
+        if (withdraw()) {
+            LOG_WARN("Node ", id, " gave up waiting for CS, Timestamp: ", getTimestamp());
+        }
+        return false;
+    }
+
+    void unlock() override {
+        releaseCriticalSection();
+    }
+
+    bool processMessage() override {
+        return receiveLamportMessage();
     }
 
 private:
+    // expired = true khi lease hết hạn và nút tự nhả; lần nhả sau đó của ứng dụng bị bỏ qua
+    void release(bool expired) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (expired) {
+                if (!inCriticalSection) return;
+                leaseLost = true;
+            }
+            else if (leaseLost) {
+                leaseLost = false;
+                return;
+            }
+            // Xóa yêu cầu của nút khỏi hàng đợi
+            if (!requestQueue.empty() && requestQueue.front().senderId == id) {
+                std::pop_heap(requestQueue.begin(), requestQueue.end(), compareMessages);
+                requestQueue.pop_back();
+                writeJournal([&](Journal& j) { j.remove(id); });
+            }
+            inCriticalSection = false;
+            LOG_INFO("Node ", id, " release CS, Timestamp: ", getTimestamp());
+
+            // Phát đi tin nhắn RELEASE đến tất cả các nút khác (trong lúc giữ queueMutex để tiền tố
+            // channel khớp với trạng thái vừa nhả)
+            incrementTimestamp();
+            broadcastLamportMessage({id, getTimestamp(), RELEASE, releaseNote.empty() ? "Release CS" : releaseNote});
+            if (!releaseNote.empty()) {
+                // Nút không nhận RELEASE của chính mình: lần vào sau của nó đọc ghi chú này
+                latestNote = std::move(releaseNote);
+                latestNoteTimestamp = getTimestamp();
+            }
+            releaseNote.clear();
+        }
+    }
+
+    // Rút yêu cầu đang chờ và phát RELEASE; false nếu không còn yêu cầu nào
+    bool withdraw() {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (!withdrawRequest()) return false;
+        incrementTimestamp();
+        broadcastLamportMessage({id, getTimestamp(), RELEASE, "Release CS"});
+        return true;
+    }
+
+    // Gọi khi đang giữ queueMutex
+    void clearState() {
+        requestQueue.clear();
+        deferredReplies.clear();
+        std::fill(replyReceived.begin(), replyReceived.end(), 1);
+        fencedUntil.clear();
+        inCriticalSection = leaseLost = false;
+        head = {-1, -1};
+        releaseNote.clear();
+        latestNoteTimestamp = 0;
+    }
+
+    // Gọi khi đang giữ queueMutex
+    bool hasOwnRequest() const {
+        return std::any_of(requestQueue.begin(), requestQueue.end(),
+                           [this](const Message& request) { return request.senderId == id; });
+    }
+
+    // Gọi khi đang giữ queueMutex; true nếu nút có yêu cầu trong hàng đợi (cần phát RELEASE)
+    bool withdrawRequest() {
+        bool pending = hasOwnRequest();
+        if (pending) removeRequest(id);
+        return pending;
+    }
+
+    // Lỗi ghi journal (vd đĩa đầy khi snapshot) chỉ được ghi log: ném ra từ luồng nhận tin sẽ làm dừng
+    // cả nút. Journal vẫn giữ trạng thái trong bộ nhớ và thử snapshot lại ở lần ghi sau.
+    template <typename Write>
+    void writeJournal(Write write) {
+        if (!journal) return;
+        try {
+            write(*journal);
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR("Node ", id, " journal write failed: ", e.what());
+        }
+    }
+
     void incrementTimestamp() {
-        lamportTimestamp++;
+        int timestamp = ++lamportTimestamp;
+        writeJournal([&](Journal& j) { j.observeClock(timestamp); });
+    }
+
+    // Đưa đồng hồ lên ít nhất timestamp, không bao giờ lùi
+    void raiseClock(int timestamp) {
+        int current = lamportTimestamp.load();
+        while (current < timestamp && !lamportTimestamp.compare_exchange_weak(current, timestamp)) {}
+        writeJournal([&](Journal& j) { j.observeClock(getTimestamp()); });
+    }
+
+    // Hàng đợi chỉ cần id, dấu thời gian và bậc ưu tiên; nội dung không được chép theo
+    void enqueue(int senderId, int timestamp, int priority) {
+        requestQueue.push_back({senderId, timestamp, REQUEST, std::string(), priority});
+        std::push_heap(requestQueue.begin(), requestQueue.end(), compareMessages);
+    }
+
+    void pushRequest(const Message& msg) {
+        enqueue(msg.senderId, msg.timestamp, msg.priority);
+        writeJournal([&](Journal& j) { j.push(msg.senderId, msg.timestamp, msg.priority); });
+    }
+
+    // Chỉ nút vừa xin với bậc cao hơn mới giữ REPLY lại (bậc thấp nhất tối đa PRIORITY_GRACE ms, bậc cao hơn
+    // ít hơn theo tỉ lệ) để lần xin sau của nó vượt được; nút khác đưa đồng hồ lên ngưỡng và trả lời ngay.
+    // Yêu cầu chỉ bị vượt trong thời gian ân hạn nên yêu cầu ưu tiên thấp không bị chờ mãi.
+    // Gọi khi đang giữ queueMutex
+    void deferReply(const Message& msg) {
+        int threshold = thresholdOf(msg);
+        if (ownPriority <= msg.priority || getTimestamp() >= threshold) {
+            raiseClock(threshold);
+            sendLamportMessage(msg.senderId, REPLY, "OK");
+            return;
+        }
+        dropDeferredReply(msg.senderId);
+        // Ngưỡng tính bằng nhịp đồng hồ, không phải thời gian: ân hạn lấy từ cấu hình
+        auto grace = std::chrono::milliseconds(static_cast<long long>(config.getPriorityGrace()) * (MAX_PRIORITY - msg.priority) / MAX_PRIORITY);
+        deferredReplies.push_back({msg.senderId, threshold, std::chrono::steady_clock::now() + grace});
+    }
+
+    void dropDeferredReply(int senderId) {
+        deferredReplies.erase(std::remove_if(deferredReplies.begin(), deferredReplies.end(),
+                                             [senderId](const DeferredReply& reply) { return reply.senderId == senderId; }),
+                              deferredReplies.end());
+    }
+
+    // Gọi khi đang giữ queueMutex
+    void sendDueReplies(std::chrono::steady_clock::time_point now) {
+        for (size_t i = 0; i < deferredReplies.size();) {
+            DeferredReply reply = deferredReplies[i];
+            if (getTimestamp() < reply.threshold && now < reply.due) {
+                i++;
+                continue;
+            }
+            deferredReplies[i] = deferredReplies.back();
+            deferredReplies.pop_back();
+            raiseClock(reply.threshold);
+            sendLamportMessage(reply.senderId, REPLY, "OK");
+        }
+    }
+
+    // Khôi phục đồng hồ và hàng đợi từ journal. Đồng hồ bắt đầu từ giới hạn đã đặt trước nên không
+    // bao giờ lùi lại; yêu cầu của chính nút này (đã mất cùng tiến trình cũ) được nhả cho các nút khác.
+    void recover() {
+        auto start = std::chrono::steady_clock::now();
+        Journal::State state = journal->recover();
+        lamportTimestamp = state.clock;
+
+        bool ownPending = false;
+        for (const auto& request : state.requests) {
+            if (request.first.first == id) {
+                ownPending = true;
+            }
+            else {
+                enqueue(request.first.first, request.first.second, request.second);
+            }
+        }
+        if (ownPending) {
+            journal->remove(id);
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        LOG_INFO("Node ", id, " recovered in ", elapsed.count(), " us, Timestamp: ", state.clock, ", ", requestQueue.size(), " queued requests");
+
+        if (ownPending) {
+            incrementTimestamp();
+            broadcastLamportMessage({id, getTimestamp(), RELEASE, "Release CS"});
+        }
     }
 
     void resetReplies() {
-        // Thiết lập lại trạng thái nhận REPLY cho yêu cầu mới
-        for (auto& entry : replyReceived) {
-            entry.second = false;
+        // Thiết lập lại trạng thái nhận REPLY cho yêu cầu mới, không chờ nút đã chết
+        std::fill(replyReceived.begin(), replyReceived.end(), 0);
+        replyReceived[0] = replyReceived[id] = 1;
+        for (int nodeId : failedNodes) {
+            replyReceived[nodeId] = 1;
+        }
+        if (restricted) {
+            for (int nodeId = 1; nodeId < (int)replyReceived.size(); nodeId++) {
+                if (!isPeer(nodeId)) replyReceived[nodeId] = 1;
+            }
         }
     }
 
-    // Phân tích nội dung tin nhắn nhận được thành cấu trúc Message
-    Message parseMessage(const std::string& messageContent) {
-        // "Id: 1, Timestamp: 5, Type: REQUEST, Content: Requesting CS"
-        int senderIdIndex = messageContent.find("Id: ");
-        int senderTimestampIndex = messageContent.find("Timestamp: ");
-        int senderTypeIndex = messageContent.find("Type: ");
-        int senderContentIndex = messageContent.find("Content: ");
+    bool isPeer(int nodeId) const {
+        return !restricted || std::find(peers.begin(), peers.end(), nodeId) != peers.end();
+    }
 
-        int senderId = std::stoi(messageContent.substr(senderIdIndex + 4, senderTimestampIndex - (senderIdIndex + 4) - 2));
-        int senderTimestamp = std::stoi(messageContent.substr(senderTimestampIndex + 11, senderTypeIndex - (senderTimestampIndex + 11) - 2));
-        std::string tmp = messageContent.substr(senderTypeIndex + 6, senderContentIndex - (senderTypeIndex + 6) - 2); 
-        MessageType senderType = (tmp == "REQUEST") ? REQUEST : (tmp == "REPLY") ? REPLY : RELEASE;
-        std::string senderContent = messageContent.substr(senderContentIndex + 9);
+    // Điều kiện để vào vùng găng, gọi khi đang giữ queueMutex
+    bool canEnter() const {
+        return std::all_of(replyReceived.begin(), replyReceived.end(), [](char received) { return received; }) &&
+                !requestQueue.empty() && requestQueue.front().senderId == id;
+    }
 
-        Message msg = {senderId, senderTimestamp, senderType, senderContent};
-        return msg;
+    // Lề cho lúc nút giữ vào vùng găng so với lúc nút này thấy được: REPLY còn thiếu của nút đó tới nơi
+    // hoặc người gửi bị nghi ngờ trong vòng TIMEOUT, và RELEASE trước đó tới hai nút lệch nhau ít hơn
+    // TIMEOUT (cả ân hạn ưu tiên, tối đa PRIORITY_GRACE ms, nhỏ hơn TIMEOUT)
+    static std::chrono::milliseconds entryMargin() {
+        return std::chrono::milliseconds(2 * config.getTimeout());
     }
 
-    // Định dạng cấu trúc Message thành chuỗi tin nhắn
-    std::string formatLamportMessage(const Message& msg) {
-        std::string typeStr = (msg.type == REQUEST) ? "REQUEST" : (msg.type == REPLY) ? "REPLY" : "RELEASE";
-        return "Id: " + std::to_string(msg.senderId) + ", Timestamp: " + std::to_string(msg.timestamp) + 
-               ", Type: " + typeStr + ", Content: " + msg.content;
+    // Nút bị nghi ngờ đã chết: không chờ REPLY của nó nữa. Nghi ngờ có thể sai (phân vùng mạng) và nút đó có
+    // thể đang ở trong vùng găng, nên yêu cầu của nó còn được giữ trong hàng đợi tới khi lease của nó chắc
+    // chắn đã hết, tính từ lần cuối nghe thấy nó; không có lease thì bỏ ngay như trước
+    void handleNodeFailure(int nodeId) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            failedNodes.insert(nodeId);
+            if (nodeId > 0 && nodeId < (int)replyReceived.size()) replyReceived[nodeId] = 1;
+            bool queued = std::any_of(requestQueue.begin(), requestQueue.end(),
+                                      [nodeId](const Message& request) { return request.senderId == nodeId; });
+            if (queued && config.getLeaseTime() > 0) {
+                fencedUntil[nodeId] = comm->lastHeard(nodeId) + entryMargin() + std::chrono::milliseconds(config.getLeaseTime());
+                LOG_WARN("Node ", id, " keeps request of failed node ", nodeId, " until its lease has run out");
+                return;
+            }
+            removeRequest(nodeId);
+        }
+        LOG_WARN("Node ", id, " dropped requests of failed node ", nodeId);
+        stateChanged.notify_all();
     }
 
-    // Xoá yêu cầu của một nút cụ thể khỏi hàng đợi
-    void removeRequest(int senderId) {
-        std::priority_queue<Message, std::vector<Message>, 
-            bool(*)(const Message&, const Message&)> tempQueue(compareMessages);
-        
-        // Di chuyển tất cả tin nhắn ngoại trừ tin nhắn của nút cần xoá vào hàng đợi tạm
-        while (!requestQueue.empty()) {
-            Message msg = requestQueue.top();
-            requestQueue.pop();
-            if (msg.senderId != senderId) {
-                tempQueue.push(msg);
+    void handleNodeRecovery(int nodeId) {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        failedNodes.erase(nodeId);
+        fencedUntil.erase(nodeId);
+    }
+
+    // Gọi khi đang giữ queueMutex: bỏ yêu cầu của các nút bị nghi ngờ đã hết lease
+    void dropFenced(std::chrono::steady_clock::time_point now) {
+        for (auto it = fencedUntil.begin(); it != fencedUntil.end();) {
+            if (now < it->second) {
+                ++it;
+                continue;
             }
+            LOG_WARN("Node ", id, " dropped requests of failed node ", it->first);
+            removeRequest(it->first);
+            it = fencedUntil.erase(it);
+            stateChanged.notify_all();
         }
-        
-        requestQueue = std::move(tempQueue);
+    }
+
+    // Gọi định kỳ theo nhịp heartbeat
+    void checkLeases() {
+        auto now = std::chrono::steady_clock::now();
+        bool expired = false;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            expired = inCriticalSection && now >= leaseExpiry;
+            dropFenced(now);
+
+            if (requestQueue.empty()) {
+                head = {-1, -1};
+            }
+            else {
+                const Message& top = requestQueue.front();
+                std::pair<int, int> current = {top.senderId, top.timestamp};
+                if (current != head) {
+                    head = current;
+                    headSince = now;
+                }
+                // Nút còn sống nhưng giữ đầu hàng đợi quá lease. headSince là lúc nút này thấy yêu cầu lên đầu,
+                // nút giữ có thể vào muộn hơn tối đa entryMargin(); không có lease thì không bao giờ loại
+                else if (top.senderId != id && config.getLeaseTime() > 0 &&
+                         now - headSince > std::chrono::milliseconds(config.getLeaseTime()) + entryMargin()) {
+                    LOG_WARN("Node ", id, " evicted expired request of node ", top.senderId, ", Timestamp: ", top.timestamp);
+                    removeRequest(top.senderId);
+                    head = {-1, -1};
+                    stateChanged.notify_all();
+                }
+            }
+        }
+
+        if (expired) {
+            LOG_WARN("Node ", id, " lease expired, releasing CS");
+            release(true);
+        }
+    }
+
+    // Phân tích tin nhắn nhận được vào msg có sẵn, không tạo chuỗi tạm (nội dung dùng lại dung lượng của msg)
+    static bool parseMessage(const std::string& messageContent, Message& msg) {
+        // "Id: 1, Timestamp: 5, Type: REQUEST, Content: Requesting CS", REQUEST ưu tiên có thêm
+        // ", Priority: 2" sau dấu thời gian
+        const char* text = messageContent.c_str();
+        char* end;
+        if (strncmp(text, "Id: ", 4) != 0) return false;
+        msg.senderId = std::strtol(text + 4, &end, 10);
+        if (strncmp(end, ", Timestamp: ", 13) != 0) return false;
+        msg.timestamp = std::strtol(end + 13, &end, 10);
+        msg.priority = 0;
+        if (strncmp(end, ", Priority: ", 12) == 0) {
+            msg.priority = std::strtol(end + 12, &end, 10);
+            if (msg.priority < 0 || msg.priority > MAX_PRIORITY) return false;
+        }
+        if (strncmp(end, ", Type: ", 8) != 0) return false;
+
+        const char* type = end + 8;
+        const char* content;
+        if (strncmp(type, "REQUEST, ", 9) == 0) { msg.type = REQUEST; content = type + 9; }
+        else if (strncmp(type, "REPLY, ", 7) == 0) { msg.type = REPLY; content = type + 7; }
+        else if (strncmp(type, "RELEASE, ", 9) == 0) { msg.type = RELEASE; content = type + 9; }
+        else return false;
+
+        if (strncmp(content, "Content: ", 9) != 0) return false;
+        content += 9;
+        msg.content.assign(content, text + messageContent.size() - content);
+        return true;
+    }
+
+    static void appendNumber(std::string& out, int value) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr - digits);
+    }
+
+    // Định dạng cấu trúc Message thành chuỗi tin nhắn, ghi vào vùng đệm riêng của luồng gọi
+    static const std::string& formatLamportMessage(const Message& msg) {
+        static thread_local std::string buffer;
+        buffer.clear();
+        buffer += "Id: ";
+        appendNumber(buffer, msg.senderId);
+        buffer += ", Timestamp: ";
+        appendNumber(buffer, msg.timestamp);
+        if (msg.priority != 0) {
+            buffer += ", Priority: ";
+            appendNumber(buffer, msg.priority);
+        }
+        buffer += ", Type: ";
+        buffer += (msg.type == REQUEST) ? "REQUEST" : (msg.type == REPLY) ? "REPLY" : "RELEASE";
+        buffer += ", Content: ";
+        buffer += msg.content;
+        return buffer;
+    }
+
+    // Xoá yêu cầu của một nút cụ thể khỏi hàng đợi, tại chỗ
+    void removeRequest(int senderId) {
+        auto removed = std::remove_if(requestQueue.begin(), requestQueue.end(),
+                                      [senderId](const Message& msg) { return msg.senderId == senderId; });
+        if (removed != requestQueue.end()) {
+            requestQueue.erase(removed, requestQueue.end());
+            std::make_heap(requestQueue.begin(), requestQueue.end(), compareMessages);
+        }
+        dropDeferredReply(senderId);
+        writeJournal([&](Journal& j) { j.remove(senderId); });
     }
 };
 
@@ -0,0 +1,32 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <chrono>
+
+// Giao diện chung của các thuật toán loại trừ tương hỗ phân tán, để công cụ tạo tải và phát lại
+// vết chạy được với mọi thuật toán mà không cần biết chi tiết giao thức
+class DistributedMutex {
+public:
+    virtual ~DistributedMutex() {}
+
+    // Vào vùng găng, chờ tối đa timeout; hết thời gian thì yêu cầu được rút lại và trả về false
+    virtual bool lock(std::chrono::milliseconds timeout) = 0;
+
+    // Như trên, kèm bậc ưu tiên (0 là thấp nhất) và hạn chót mong muốn tính từ lúc gọi (0 = không có).
+    // Thuật toán không hỗ trợ ưu tiên thì bỏ qua hai tham số này
+    virtual bool lock(std::chrono::milliseconds timeout, int priority, std::chrono::milliseconds deadline) {
+        (void)priority;
+        (void)deadline;
+        return lock(timeout);
+    }
+
+    virtual void unlock() = 0;
+
+    // Xử lý một tin nhắn đến; gọi lặp lại từ một luồng, trả về false khi Comm đã dừng
+    virtual bool processMessage() = 0;
+
+    // Nhả vùng găng hoặc rút yêu cầu đang chờ, đánh thức luồng đang chờ lock()
+    virtual void shutdown() = 0;
+};
+
+#endif // MUTEX_H
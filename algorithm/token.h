@@ -0,0 +1,290 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include "node.h"
+#include "log.h"
+#include "mutex.h"
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <charconv>
+#include <algorithm>
+#include <condition_variable>
+
+extern Logger logger;
+
+// Loại trừ tương hỗ Suzuki–Kasami: chỉ nút giữ thẻ bài được vào vùng găng. Nút muốn vào phát
+// TOKEN_REQUEST kèm số thứ tự; nút giữ thẻ đang rảnh chuyển thẻ ngay, đang dùng thì xếp nút đó vào
+// hàng đợi trong thẻ lúc nhả. Nút vẫn còn giữ thẻ vào lại không tốn tin nhắn nào, nên hợp khi một nút
+// chiếm phần lớn lượt vào. Khác LamportNode: không có lease, không có journal, thẻ mất theo nút chết
+// thì không được tạo lại.
+class TokenNode : public Node, public DistributedMutex {
+private:
+    std::mutex mutex;
+    std::condition_variable stateChanged;
+    std::vector<int> requested;         // RN: số thứ tự yêu cầu lớn nhất đã thấy của từng nút, đánh chỉ số theo id
+    std::vector<int> served;            // LN, đi theo thẻ: số thứ tự yêu cầu đã được phục vụ của từng nút
+    std::deque<int> waiting;            // Hàng đợi đi theo thẻ
+    std::string note;                   // Ghi chú đi theo thẻ (AdaptiveMutex ghi thống kê vào đây)
+    bool hasToken;
+    bool wanting = false;               // Có luồng đang chờ thẻ trong lock()
+    bool inCriticalSection = false;
+    bool stopped = false;
+    bool parked = false;                // Đã gọi park(): lock() trả về false cho tới reset() sau
+    unsigned generation = 0;            // Tăng mỗi lần reset() để luồng đang chờ thôi chờ
+    std::string channel;                // Tiền tố của mọi tin nhắn gửi đi
+    std::string incomingBuffer;
+
+public:
+    TokenNode(int id, const std::string& ip, int port, std::shared_ptr<Comm> comm, bool holdsToken)
+        : Node(id, ip, port, comm), requested(config.getTotalNodes() + 1, 0), served(config.getTotalNodes() + 1, 0),
+          hasToken(holdsToken) {
+    }
+
+    // Khi chạy riêng, thẻ bắt đầu ở nút có id nhỏ nhất
+    static bool isInitialHolder(int id) {
+        int first = id;
+        for (const NodeInfo& node : config.getNodes()) {
+            first = std::min(first, node.id);
+        }
+        return id == first;
+    }
+
+    bool lock(std::chrono::milliseconds timeout) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopped || parked) return false;
+        if (!hasToken) {
+            wanting = true;
+            int sequence = ++requested[id];
+            broadcast(formatRequest(sequence));
+
+            unsigned start = generation;
+            stateChanged.wait_for(lock, timeout, [&] { return stopped || parked || generation != start || hasToken; });
+            wanting = false;
+            if (stopped || parked || generation != start || !hasToken) {
+                // Thẻ tới sau khi đã thôi chờ thì được chuyển tiếp lúc nhận
+                return false;
+            }
+        }
+        inCriticalSection = true;
+        LOG_INFO("Node ", id, " enter CS (token)");
+        return true;
+    }
+
+    void unlock() override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!inCriticalSection) return;
+        inCriticalSection = false;
+        LOG_INFO("Node ", id, " release CS (token)");
+        served[id] = requested[id];
+        passToken();
+    }
+
+    bool processMessage() override {
+        if (!comm->getMessage(incomingBuffer)) {
+            return false;
+        }
+        handleMessage(incomingBuffer);
+        return true;
+    }
+
+    // Xử lý tin nhắn đã nhận (không có tiền tố channel); chỉ gọi từ luồng nhận
+    void handleMessage(const std::string& text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!parseMessage(text)) {
+            LOG_WARN("Node ", id, " ignored malformed message: ", text);
+            return;
+        }
+        if (hasToken && !wanting && !inCriticalSection) {
+            // Thẻ rảnh (hoặc tới sau khi lock() đã hết thời gian): phục vụ luôn lượt của chính nút này
+            served[id] = requested[id];
+            passToken();
+            if (stopped) handOff();
+        }
+        stateChanged.notify_all();
+    }
+
+    // Giao thẻ cho nút đang chờ, không có ai thì cho một nút khác còn sống để thẻ không mất theo tiến trình
+    void shutdown() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopped) return;
+            stopped = true;
+            wanting = inCriticalSection = false;
+            if (hasToken) {
+                served[id] = requested[id];
+                passToken();
+                handOff();
+            }
+        }
+        stateChanged.notify_all();
+    }
+
+    // Chỉ có nghĩa ở nút đang giữ thẻ
+    std::string getNote() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return note;
+    }
+
+    void setNote(const std::string& text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        note = text;
+    }
+
+    // Bắt đầu lại từ đầu (thẻ mới ở nút này nếu holdsToken) mà không gửi gì; tin nhắn sau có tiền tố mới
+    void reset(const std::string& prefix, bool holdsToken, const std::string& text) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            clearState();
+            hasToken = holdsToken;
+            parked = false;
+            channel = prefix;
+            note = text;
+        }
+        stateChanged.notify_all();
+    }
+
+    // Bỏ thẻ và trạng thái như reset() rồi thôi nhận lock() cho tới reset() sau (AdaptiveMutex đã đổi giao thức)
+    void park() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            clearState();
+            hasToken = false;
+            parked = true;
+            note.clear();
+        }
+        stateChanged.notify_all();
+    }
+
+private:
+    // Gọi khi đang giữ mutex
+    void clearState() {
+        std::fill(requested.begin(), requested.end(), 0);
+        std::fill(served.begin(), served.end(), 0);
+        waiting.clear();
+        inCriticalSection = false;
+        generation++;
+    }
+
+    // Gọi khi đang giữ mutex và giữ thẻ: xếp các nút có yêu cầu chưa được phục vụ vào hàng đợi của thẻ
+    // rồi chuyển thẻ cho nút đầu hàng còn sống
+    void passToken() {
+        for (int nodeId = 1; nodeId < (int)requested.size(); nodeId++) {
+            if (nodeId != id && requested[nodeId] > served[nodeId] &&
+                std::find(waiting.begin(), waiting.end(), nodeId) == waiting.end()) {
+                waiting.push_back(nodeId);
+            }
+        }
+        while (hasToken && !waiting.empty()) {
+            int next = waiting.front();
+            waiting.pop_front();
+            if (!comm->isSuspected(next)) sendToken(next);
+        }
+    }
+
+    // Gọi khi đang giữ mutex sau khi dừng: không còn ai chờ thì thẻ vẫn phải rời tiến trình này
+    void handOff() {
+        for (const NodeInfo& node : config.getNodes()) {
+            if (!hasToken) break;
+            if (node.id != id && !comm->isSuspected(node.id)) sendToken(node.id);
+        }
+    }
+
+    // Gọi khi đang giữ mutex; gửi không được thì thẻ vẫn ở lại nút này
+    void sendToken(int receiverId) {
+        std::string message = channel;
+        message += "Id: ";
+        appendNumber(message, id);
+        message += ", Type: TOKEN, Served:";
+        for (int nodeId = 1; nodeId < (int)served.size(); nodeId++) {
+            message += ' ';
+            appendNumber(message, served[nodeId]);
+        }
+        message += ", Queue:";
+        for (int nodeId : waiting) {
+            message += ' ';
+            appendNumber(message, nodeId);
+        }
+        message += ", Note: ";
+        message += note;
+
+        try {
+            comm->send(receiverId, message);
+        } catch (const std::exception& e) {
+            LOG_WARN("Send token to node ", receiverId, " failed: ", e.what());
+            return;
+        }
+        hasToken = false;
+        LOG_DEBUG(message.c_str() + channel.size(), ", To: ", receiverId);
+    }
+
+    std::string formatRequest(int sequence) {
+        std::string message = channel;
+        message += "Id: ";
+        appendNumber(message, id);
+        message += ", Type: TOKEN_REQUEST, Seq: ";
+        appendNumber(message, sequence);
+        return message;
+    }
+
+    // Gọi khi đang giữ mutex
+    void broadcast(const std::string& message) {
+        try {
+            comm->broadcast(message);
+        } catch (const std::exception& e) {
+            LOG_WARN("Broadcast failed: ", e.what());
+        }
+        LOG_DEBUG(message.c_str() + channel.size(), ", To: all");
+    }
+
+    // "Id: 2, Type: TOKEN_REQUEST, Seq: 5" hoặc "Id: 1, Type: TOKEN, Served: 3 0 4, Queue: 2, Note: ..."
+    bool parseMessage(const std::string& text) {
+        const char* p = text.c_str();
+        char* end;
+        if (strncmp(p, "Id: ", 4) != 0) return false;
+        int senderId = std::strtol(p + 4, &end, 10);
+        if (senderId <= 0 || senderId >= (int)requested.size()) return false;
+
+        if (strncmp(end, ", Type: TOKEN_REQUEST, Seq: ", 28) == 0) {
+            int sequence = std::strtol(end + 28, &end, 10);
+            requested[senderId] = std::max(requested[senderId], sequence);
+            return true;
+        }
+        if (strncmp(end, ", Type: TOKEN, Served:", 22) != 0) return false;
+        // Đọc vào biến tạm: thẻ hỏng không được làm sai trạng thái hiện tại
+        p = end + 22;
+        std::vector<int> tokenServed(served.size(), 0);
+        for (int nodeId = 1; nodeId < (int)tokenServed.size(); nodeId++) {
+            tokenServed[nodeId] = std::strtol(p, &end, 10);
+            if (end == p) return false;
+            p = end;
+        }
+        if (strncmp(p, ", Queue:", 8) != 0) return false;
+        p += 8;
+        std::deque<int> tokenWaiting;
+        while (*p == ' ') {
+            int nodeId = std::strtol(p, &end, 10);
+            if (end == p || nodeId <= 0 || nodeId >= (int)served.size()) return false;
+            tokenWaiting.push_back(nodeId);
+            p = end;
+        }
+        if (strncmp(p, ", Note: ", 8) != 0) return false;
+        served = std::move(tokenServed);
+        waiting = std::move(tokenWaiting);
+        note.assign(p + 8, text.c_str() + text.size());
+        hasToken = true;
+        return true;
+    }
+
+    static void appendNumber(std::string& out, int value) {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr - digits);
+    }
+};
+
+#endif // TOKEN_H
@@ -0,0 +1,285 @@
+#ifndef TOTAL_ORDER_H
+#define TOTAL_ORDER_H
+
+#include "node.h"
+#include "log.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <charconv>
+
+extern Logger logger;
+
+// Một cập nhật đã được giao theo thứ tự toàn cục
+struct LogEntry {
+    int senderId;
+    int timestamp;
+    std::string update;
+};
+
+// Multicast có thứ tự toàn phần dựa trên đồng hồ Lamport. Mỗi đợt gửi gom mọi cập nhật đang chờ
+// dưới một dấu thời gian; đợt (timestamp, senderId) được giao khi đã nhận từ mọi nút khác một tin nhắn
+// có dấu thời gian lớn hơn (kênh FIFO nên không còn đợt nào nhỏ hơn đang trên đường tới).
+// Mọi nút giao cùng một chuỗi cập nhật, tạo thành log nhân bản.
+class TotalOrderNode : public Node {
+private:
+    enum MessageType { UPDATE, ACK };
+
+    std::mutex stateMutex;
+    std::condition_variable outgoingReady;
+    int lamportTimestamp = 0;
+    std::vector<std::string> outgoing;                              // Cập nhật chờ đợt gửi sau
+    bool ackPending = false;                                        // Đã nhận UPDATE nhưng chưa báo lại
+    std::map<std::pair<int, int>, std::vector<std::string>> holdback; // (timestamp, senderId) -> đợt cập nhật
+    std::map<int, int> latest;                                      // Dấu thời gian lớn nhất nhận từ mỗi nút
+    std::set<int> failedNodes;
+    std::vector<LogEntry> replicatedLog;
+
+    std::mutex deliverMutex;                                        // Giữ thứ tự gọi onDeliver
+    std::function<void(const LogEntry&)> onDeliver;
+    size_t maxBatch;
+    bool running = true;
+    int failureSubscription;
+    std::thread sender;
+
+public:
+    TotalOrderNode(int id, const std::string& ip, int port, std::shared_ptr<Comm> comm, size_t maxBatch = 1024)
+        : Node(id, ip, port, comm), maxBatch(maxBatch) {
+        FailureDetector::Listener listener;
+        listener.onSuspect = [this](int nodeId) { handleNodeFailure(nodeId); };
+        listener.onRecover = [this](int nodeId) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            failedNodes.erase(nodeId);
+        };
+        failureSubscription = comm->subscribe(listener);
+        sender = std::thread(&TotalOrderNode::sendLoop, this);
+    }
+
+    ~TotalOrderNode() {
+        comm->unsubscribe(failureSubscription);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            running = false;
+        }
+        outgoingReady.notify_all();
+        if (sender.joinable()) {
+            sender.join();
+        }
+    }
+
+    // Gọi trước khi bắt đầu nhận tin nhắn
+    void setDeliverCallback(std::function<void(const LogEntry&)> callback) {
+        onDeliver = callback;
+    }
+
+    // Đưa cập nhật vào đợt gửi kế tiếp; trong lúc một đợt đang gửi, các cập nhật mới dồn vào đợt sau
+    void submit(std::string update) {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            outgoing.push_back(std::move(update));
+        }
+        outgoingReady.notify_one();
+    }
+
+    // Xử lý một tin nhắn nhận được; chỉ gọi từ một luồng. Trả về false khi Comm đã dừng
+    bool receiveMessage() {
+        std::string messageContent;
+        if (!comm->getMessage(messageContent)) {
+            return false;
+        }
+        int senderId, senderTimestamp;
+        MessageType type;
+        std::string content;
+        std::vector<std::string> batch;
+        if (!parseMessage(messageContent, senderId, senderTimestamp, type, content) ||
+            (type == UPDATE && !decodeBatch(content, batch))) {
+            LOG_WARN("Node ", id, " ignored malformed message: ", messageContent);
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            lamportTimestamp = std::max(lamportTimestamp, senderTimestamp) + 1;
+            int& seen = latest[senderId];
+            seen = std::max(seen, senderTimestamp);
+
+            if (type == UPDATE) {
+                holdback[{senderTimestamp, senderId}] = std::move(batch);
+                ackPending = true;
+            }
+        }
+        if (type == UPDATE) {
+            outgoingReady.notify_one();
+        }
+
+        deliverReady();
+        return true;
+    }
+
+    int getTimestamp() {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        return lamportTimestamp;
+    }
+
+    size_t logSize() {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        return replicatedLog.size();
+    }
+
+    std::vector<LogEntry> getLog() {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        return replicatedLog;
+    }
+
+private:
+    // Luồng gửi duy nhất: dấu thời gian tăng dần theo đúng thứ tự gửi đi trên kênh FIFO
+    void sendLoop() {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        while (running) {
+            outgoingReady.wait(lock, [this] { return !running || !outgoing.empty() || ackPending; });
+            if (!running) break;
+
+            std::vector<std::string> batch;
+            if (outgoing.size() <= maxBatch) {
+                batch.swap(outgoing);
+            }
+            else {
+                batch.assign(std::make_move_iterator(outgoing.begin()), std::make_move_iterator(outgoing.begin() + maxBatch));
+                outgoing.erase(outgoing.begin(), outgoing.begin() + maxBatch);
+            }
+            ackPending = false;
+
+            // Một đợt UPDATE cũng là ACK cho mọi tin nhắn đã nhận trước nó
+            int timestamp = ++lamportTimestamp;
+            MessageType type = batch.empty() ? ACK : UPDATE;
+            std::string messageContent = formatMessage(timestamp, type, encodeBatch(batch));
+            if (type == UPDATE) {
+                holdback[{timestamp, id}] = std::move(batch);
+            }
+            lock.unlock();
+
+            try {
+                comm->broadcast(messageContent);
+            } catch (const std::exception& e) {
+                LOG_WARN("Broadcast failed: ", e.what());
+            }
+            LOG_DEBUG("Id: ", id, ", Timestamp: ", timestamp, ", Type: ", type == UPDATE ? "UPDATE" : "ACK");
+
+            deliverReady();
+            lock.lock();
+        }
+    }
+
+    // Giao mọi đợt ở đầu hàng chờ đã ổn định
+    void deliverReady() {
+        std::lock_guard<std::mutex> deliverLock(deliverMutex);
+        size_t first, last;
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            first = replicatedLog.size();
+            while (!holdback.empty() && isStable(holdback.begin()->first)) {
+                auto it = holdback.begin();
+                for (auto& update : it->second) {
+                    replicatedLog.push_back({it->first.second, it->first.first, std::move(update)});
+                }
+                holdback.erase(it);
+            }
+            last = replicatedLog.size();
+        }
+
+        // Chỉ luồng giữ deliverMutex thêm vào log nên các phần tử này không đổi
+        for (size_t i = first; i < last; i++) {
+            const LogEntry& entry = replicatedLog[i];
+            LOG_DEBUG("Node ", id, " deliver Id: ", entry.senderId, ", Timestamp: ", entry.timestamp);
+            if (onDeliver) onDeliver(entry);
+        }
+    }
+
+    // Gọi khi đang giữ stateMutex
+    bool isStable(const std::pair<int, int>& key) const {
+        int timestamp = key.first, senderId = key.second;
+        for (const NodeInfo& node : config.getNodes()) {
+            int nodeId = node.id;
+            if (nodeId == id || failedNodes.count(nodeId)) continue;
+
+            auto it = latest.find(nodeId);
+            int seen = (it == latest.end()) ? -1 : it->second;
+            // Nút gửi: chính đợt này là đủ; nút khác: cần một tin nhắn mới hơn
+            if (nodeId == senderId ? seen < timestamp : seen <= timestamp) return false;
+        }
+        return true;
+    }
+
+    // Không chờ nút đã chết nữa; các đợt của nó đã nhận vẫn được giao
+    void handleNodeFailure(int nodeId) {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            failedNodes.insert(nodeId);
+        }
+        deliverReady();
+    }
+
+    // "Id: 1, Timestamp: 5, Type: UPDATE, Content: 3:abc2:de"
+    std::string formatMessage(int timestamp, MessageType type, const std::string& content) const {
+        return "Id: " + std::to_string(id) + ", Timestamp: " + std::to_string(timestamp) +
+               ", Type: " + (type == UPDATE ? "UPDATE" : "ACK") + ", Content: " + content;
+    }
+
+    static bool parseMessage(const std::string& messageContent, int& senderId, int& timestamp, MessageType& type, std::string& content) {
+        size_t idIndex = messageContent.find("Id: ");
+        size_t timestampIndex = messageContent.find(", Timestamp: ");
+        size_t typeIndex = messageContent.find(", Type: ");
+        size_t contentIndex = messageContent.find(", Content: ");
+        if (idIndex != 0 || timestampIndex == std::string::npos || typeIndex == std::string::npos || contentIndex == std::string::npos) {
+            return false;
+        }
+
+        try {
+            senderId = std::stoi(messageContent.substr(4, timestampIndex - 4));
+            timestamp = std::stoi(messageContent.substr(timestampIndex + 13, typeIndex - (timestampIndex + 13)));
+        } catch (const std::exception&) {
+            return false;
+        }
+        std::string typeStr = messageContent.substr(typeIndex + 8, contentIndex - (typeIndex + 8));
+        if (typeStr != "UPDATE" && typeStr != "ACK") return false;
+        type = (typeStr == "UPDATE") ? UPDATE : ACK;
+        content = messageContent.substr(contentIndex + 11);
+        return true;
+    }
+
+    // Mỗi cập nhật được ghi "<độ dài>:<dữ liệu>" nên có thể chứa ký tự bất kỳ
+    static std::string encodeBatch(const std::vector<std::string>& batch) {
+        std::string encoded;
+        for (const auto& update : batch) {
+            encoded += std::to_string(update.size());
+            encoded += ':';
+            encoded += update;
+        }
+        return encoded;
+    }
+
+    // Dữ liệu từ mạng: độ dài hỏng hoặc vượt quá phần còn lại thì trả về false, không ném ngoại lệ
+    static bool decodeBatch(const std::string& encoded, std::vector<std::string>& batch) {
+        batch.clear();
+        const char* data = encoded.data();
+        size_t pos = 0;
+        while (pos < encoded.size()) {
+            size_t length;
+            auto result = std::from_chars(data + pos, data + encoded.size(), length);
+            if (result.ec != std::errc() || result.ptr == data + encoded.size() || *result.ptr != ':') return false;
+            size_t start = result.ptr + 1 - data;
+            if (length > encoded.size() - start) return false;
+            batch.emplace_back(encoded, start, length);
+            pos = start + length;
+        }
+        return true;
+    }
+};
+
+#endif // TOTAL_ORDER_H
@@ -0,0 +1,539 @@
+// g++ application/lockDaemon.cpp -o application/lockDaemon -lpthread -lrt -Iframework -Ialgorithm
+
+#include "node.h"
+#include "lamport.h"
+#include "runtime.h"
+#include <iostream>
+#include <thread>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+using namespace std;
+
+Logger logger;
+Config config;
+
+// Dich vu khoa: nut Lamport nay phuc vu moi tien trinh tren cung may qua Unix domain socket, dia chi
+// trong abstract namespace "lamport_lockd_<id>" (vd: socat - ABSTRACT-CONNECT:lamport_lockd_1).
+// Moi dong mot lenh, client gui nhieu lenh lien tiep khong can cho tra loi:
+//   ACQUIRE <ma>              cho toi khi duoc khoa
+//   TRYACQUIRE <ma> <ms>      cho toi da ms mili giay
+//   RELEASE <ma>              nha khoa, hoac huy yeu cau dang cho
+// Tra loi: GRANTED <ma>, TIMEOUT <ma>, RELEASED <ma>, EXPIRED <ma> (het lease, khoa da bi nha thay client),
+// ERROR <ma> <ly do>. Client ngat ket noi thi khoa va cac yeu cau cua no duoc nha.
+// Cac client dang cho dung chung mot yeu cau Lamport: moi lan nut vao vung gang, toi da LOCK_BATCH client
+// lan luot giu khoa roi nut moi nha cho nut khac.
+class LockDaemon {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t MAX_LINE = 4096;
+    static constexpr int LEASE_CHECK_MS = 100;
+
+    struct Client {
+        std::string in, out;
+    };
+
+    struct Waiter {
+        int fd;
+        std::string requestId;
+        Clock::time_point deadline;
+    };
+
+    LamportNode& lamport;
+    int id;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;                                    // Luong cho vung gang bao da vao duoc
+    int stopFd;                                         // Runtime yeu cau dung
+    std::map<int, Client> clients;
+    std::deque<Waiter> waiters;
+
+    bool requested = false;                             // Yeu cau Lamport dang cho
+    bool held = false;                                  // Nut dang o trong vung gang
+    int holderFd = -1;
+    std::string holderId;
+    int grantedInRound = 0;
+    Clock::time_point roundStart;
+
+    bool stopping = false;                              // Da co yeu cau dung: chi con cho client giu khoa nha
+
+    std::mutex watchMutex;
+    std::condition_variable watchRequested;
+    bool watching = false;
+    bool requestLost = false;                           // Yeu cau Lamport bi xoa ma khong vao duoc vung gang
+    bool running = true;
+    bool closed = false;                                // Moi client da nhan tra loi cuoi va bi dong
+    std::condition_variable closedChanged;
+    std::thread watcher;
+
+public:
+    LockDaemon(LamportNode& lamport, int id, int stopFd) : lamport(lamport), id(id), stopFd(stopFd) {
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throw std::runtime_error("Failed to create lock socket");
+        }
+
+        std::string name = "lamport_lockd_" + std::to_string(id);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path + 1, name.data(), name.size());
+        socklen_t length = offsetof(sockaddr_un, sun_path) + 1 + name.size();
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), length) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+            close(listenFd);
+            throw std::runtime_error("Failed to listen on @" + name + ": " + strerror(errno));
+        }
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        watch(listenFd, EPOLLIN);
+        watch(wakeFd, EPOLLIN);
+        watch(stopFd, EPOLLIN);
+
+        watcher = std::thread(&LockDaemon::watchCriticalSection, this);
+        LOG_INFO("Node ", id, " lock service listening on @", name);
+    }
+
+    ~LockDaemon() {
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            running = false;
+        }
+        watchRequested.notify_one();
+        watcher.join();
+
+        for (const auto& client : clients) {
+            close(client.first);
+        }
+        close(wakeFd);
+        close(epollFd);
+        close(listenFd);
+    }
+
+    // Vong lap su kien; chi chay tren mot luong. Khi stopFd doc duoc: cho client giu khoa nha (toi het
+    // lease), dong moi client roi ket thuc
+    void run() {
+        try {
+            serve();
+        } catch (...) {
+            closeClients();
+            throw;
+        }
+        closeClients();
+    }
+
+    // Buoc dung chay truoc LamportNode::shutdown(): cho toi khi khong client nao con tuong minh giu khoa
+    void waitClosed() {
+        std::unique_lock<std::mutex> lock(watchMutex);
+        closedChanged.wait(lock, [this] { return closed; });
+    }
+
+private:
+    void serve() {
+        epoll_event events[64];
+        while (true) {
+            int n = epoll_wait(epollFd, events, 64, nextTimeout());
+            if (n < 0 && errno != EINTR) {
+                throw std::runtime_error(std::string("epoll_wait failed: ") + strerror(errno));
+            }
+
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == stopFd) {
+                    beginStop();
+                }
+                else if (fd == listenFd) {
+                    acceptClients();
+                }
+                else if (fd == wakeFd) {
+                    uint64_t count;
+                    if (read(wakeFd, &count, sizeof(count)) > 0) woken();
+                }
+                else if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    disconnect(fd);
+                }
+                else {
+                    if (events[i].events & EPOLLOUT) flush(fd);
+                    if (events[i].events & (EPOLLIN | EPOLLRDHUP)) receive(fd);
+                }
+            }
+
+            expireWaiters();
+            checkLease();
+            if (stopping && holderFd < 0) return;
+        }
+    }
+
+    void watch(int fd, uint32_t events) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    // Luong rieng cho yeu cau Lamport duoc chap nhan (hoac bi xoa) roi danh thuc vong lap su kien qua eventfd.
+    // Nut da shutdown() thi khong bao gio vao duoc nua: thoat thay vi quay vong
+    void watchCriticalSection() {
+        std::unique_lock<std::mutex> lock(watchMutex);
+        while (true) {
+            watchRequested.wait(lock, [this] { return watching || !running; });
+            if (!running) break;
+            lock.unlock();
+            bool entered = lamport.waitForCriticalSection(std::chrono::seconds(1));
+            lock.lock();
+            if (!entered && lamport.isStopped()) {
+                watching = false;
+                break;
+            }
+            if (entered || !lamport.isRequesting()) {
+                watching = false;
+                requestLost = !entered;
+                uint64_t one = 1;
+                if (write(wakeFd, &one, sizeof(one)) < 0) {
+                    LOG_ERROR("Node ", id, " failed to wake lock service: ", strerror(errno));
+                }
+            }
+        }
+    }
+
+    int nextTimeout() const {
+        long timeout = -1;
+        auto now = Clock::now();
+        for (const Waiter& waiter : waiters) {
+            if (waiter.deadline == Clock::time_point::max()) continue;
+            long remaining = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(waiter.deadline - now).count() + 1);
+            if (timeout < 0 || remaining < timeout) timeout = remaining;
+        }
+        if (holderFd >= 0 && (timeout < 0 || timeout > LEASE_CHECK_MS)) {
+            timeout = LEASE_CHECK_MS;
+        }
+        return static_cast<int>(timeout);
+    }
+
+    void acceptClients() {
+        int fd;
+        while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            clients[fd];
+            watch(fd, EPOLLIN | EPOLLRDHUP);
+        }
+    }
+
+    void receive(int fd) {
+        auto it = clients.find(fd);
+        if (it == clients.end()) return;
+
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            it->second.in.append(buffer, n);
+        }
+        bool closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+
+        // Lenh da nhan truoc khi client dong ket noi van duoc xu ly
+        std::string& in = it->second.in;
+        size_t start = 0, end;
+        while ((end = in.find('\n', start)) != std::string::npos) {
+            handle(fd, in.substr(start, end - start));
+            if (!clients.count(fd)) return;
+            start = end + 1;
+        }
+        in.erase(0, start);
+        if (closed) {
+            disconnect(fd);
+        }
+        else if (in.size() > MAX_LINE) {
+            LOG_WARN("Node ", id, " lock client sent an overlong line, disconnected");
+            disconnect(fd);
+        }
+    }
+
+    void handle(int fd, const std::string& line) {
+        std::istringstream words(line);
+        std::string command, requestId;
+        words >> command >> requestId;
+        if (command.empty()) return;
+        if (requestId.empty()) {
+            reply(fd, "ERROR - missing request id");
+            return;
+        }
+
+        if (command == "ACQUIRE" || command == "TRYACQUIRE") {
+            if (stopping) {
+                reply(fd, "ERROR " + requestId + " shutting down");
+                return;
+            }
+            Clock::time_point deadline = Clock::time_point::max();
+            if (command == "TRYACQUIRE") {
+                long timeout;
+                if (!(words >> timeout) || timeout < 0) {
+                    reply(fd, "ERROR " + requestId + " invalid timeout");
+                    return;
+                }
+                deadline = Clock::now() + std::chrono::milliseconds(timeout);
+            }
+            waiters.push_back({fd, requestId, deadline});
+            schedule();
+        }
+        else if (command == "RELEASE") {
+            if (holderFd == fd && holderId == requestId) {
+                holderFd = -1;
+                reply(fd, "RELEASED " + requestId);
+                schedule();
+                return;
+            }
+            for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+                if (it->fd == fd && it->requestId == requestId) {
+                    waiters.erase(it);
+                    reply(fd, "RELEASED " + requestId);
+                    return;
+                }
+            }
+            reply(fd, "ERROR " + requestId + " not held");
+        }
+        else {
+            reply(fd, "ERROR " + requestId + " unknown command " + command);
+        }
+    }
+
+    // Cap khoa cho client ke tiep neu nut dang o trong vung gang, neu khong thi xin vao vung gang
+    void schedule() {
+        if (holderFd >= 0) return;
+
+        if (held) {
+            // Chi cap them khi nut con giu lease va lease con du cho client moi
+            bool leaseLeft = lamport.holdsLease() &&
+                             (config.getLeaseTime() <= 0 ||
+                              Clock::now() - roundStart < std::chrono::milliseconds(config.getLeaseTime() / 2));
+            if (!waiters.empty() && grantedInRound < config.getLockBatch() && leaseLeft) {
+                Waiter waiter = std::move(waiters.front());
+                waiters.pop_front();
+                holderFd = waiter.fd;
+                holderId = std::move(waiter.requestId);
+                grantedInRound++;
+                reply(holderFd, "GRANTED " + holderId);
+                return;
+            }
+            lamport.releaseCriticalSection();
+            held = false;
+        }
+
+        if (!waiters.empty() && !requested) {
+            requested = true;
+            lamport.requestCriticalSection();
+            {
+                std::lock_guard<std::mutex> lock(watchMutex);
+                watching = true;
+            }
+            watchRequested.notify_one();
+        }
+    }
+
+    void woken() {
+        bool lost;
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            lost = requestLost;
+            requestLost = false;
+        }
+        if (!lost) {
+            entered();
+            return;
+        }
+        // Yeu cau da bi xoa (vd reset()): xin lai neu con client cho
+        LOG_WARN("Node ", id, " Lamport request was dropped before entering, requesting again");
+        requested = false;
+        schedule();
+    }
+
+    void entered() {
+        requested = false;
+        held = true;
+        grantedInRound = 0;
+        roundStart = Clock::now();
+        lamport.enterCriticalSection();
+        // Moi client dang cho da het han hoac huy: schedule() nha vung gang ngay
+        schedule();
+    }
+
+    void expireWaiters() {
+        auto now = Clock::now();
+        std::vector<Waiter> expired;
+        for (auto it = waiters.begin(); it != waiters.end();) {
+            if (it->deadline <= now) {
+                expired.push_back(std::move(*it));
+                it = waiters.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        // Tra loi sau khi xoa xong: gui loi co the ngat ket noi va sua waiters
+        for (const Waiter& waiter : expired) {
+            reply(waiter.fd, "TIMEOUT " + waiter.requestId);
+        }
+    }
+
+    // Lease het khi client giu khoa qua lau: LamportNode da (hoac sap) tu nha, bao cho client
+    void checkLease() {
+        if (holderFd < 0 || lamport.holdsLease()) return;
+
+        LOG_WARN("Node ", id, " lease expired while held by lock client ", holderId);
+        expireHolder();
+    }
+
+    // Nha truoc khi tra loi: gui loi co the ngat ket noi, disconnect() se goi schedule() lan nua
+    void expireHolder() {
+        int fd = holderFd;
+        holderFd = -1;
+        lamport.releaseCriticalSection();
+        held = false;
+        reply(fd, "EXPIRED " + holderId);
+        schedule();
+    }
+
+    // Ngung nhan client va yeu cau moi; client giu khoa duoc toi het lease de nha nhu HierarchicalMutex,
+    // khong co lease thi nhan EXPIRED ngay
+    void beginStop() {
+        stopping = true;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, stopFd, nullptr);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+
+        std::deque<Waiter> dropped;
+        dropped.swap(waiters);
+        for (const Waiter& waiter : dropped) {
+            reply(waiter.fd, "ERROR " + waiter.requestId + " shutting down");
+        }
+
+        if (holderFd < 0) return;
+        if (config.getLeaseTime() > 0) {
+            LOG_INFO("Node ", id, " waits for lock client ", holderId, " to release before stopping");
+        }
+        else {
+            expireHolder();
+        }
+    }
+
+    // Gui not phan con lai cho moi client roi dong; sau do LamportNode moi duoc nha vung gang
+    void closeClients() {
+        for (auto& client : clients) {
+            if (!client.second.out.empty()) {
+                send(client.first, client.second.out.data(), client.second.out.size(), MSG_NOSIGNAL);
+            }
+            close(client.first);
+        }
+        clients.clear();
+        holderFd = -1;
+        waiters.clear();
+        {
+            std::lock_guard<std::mutex> lock(watchMutex);
+            closed = true;
+        }
+        closedChanged.notify_all();
+    }
+
+    void reply(int fd, const std::string& message) {
+        auto it = clients.find(fd);
+        if (it == clients.end()) return;
+
+        bool idle = it->second.out.empty();
+        it->second.out += message;
+        it->second.out += '\n';
+        if (idle) flush(fd);
+    }
+
+    void flush(int fd) {
+        auto it = clients.find(fd);
+        if (it == clients.end()) return;
+
+        std::string& out = it->second.out;
+        bool wasBlocked = false;
+        while (!out.empty()) {
+            ssize_t n = send(fd, out.data(), out.size(), MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    wasBlocked = true;
+                    break;
+                }
+                disconnect(fd);
+                return;
+            }
+            out.erase(0, n);
+        }
+
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP | (wasBlocked ? static_cast<uint32_t>(EPOLLOUT) : 0);
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+
+    void disconnect(int fd) {
+        if (!clients.erase(fd)) return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+
+        for (auto it = waiters.begin(); it != waiters.end();) {
+            it = (it->fd == fd) ? waiters.erase(it) : it + 1;
+        }
+        if (holderFd == fd) {
+            LOG_WARN("Node ", id, " lock client ", holderId, " disconnected while holding the lock");
+            holderFd = -1;
+            schedule();
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Please enter ID\n";
+        return 1;
+    }
+
+    Runtime runtime;    // Truoc moi luong khac de chung cung chan SIGINT/SIGTERM
+
+    logger.setMethods(true, true);
+    logger.setLevel(config.getLogLevel());
+    logger.init();
+
+    int id = std::stoi(argv[1]);
+    std::string ip = config.getNodeIp(id);
+    int port = config.getNodePort(id);
+    std::shared_ptr<Comm> comm = std::make_shared<Comm>(id, port);
+    LamportNode lamportNode(id, ip, port, comm);
+    lamportNode.initialize();
+
+    std::unique_ptr<LockDaemon> daemon;
+    try {
+        daemon = std::make_unique<LockDaemon>(lamportNode, id, runtime.stopDescriptor());
+    } catch (const std::exception& e) {
+        LOG_ERROR("Lock service failed to start: ", e.what());
+        return 1;
+    }
+
+    runtime.spawn([&] {
+        while (lamportNode.receiveLamportMessage()) {}
+    });
+    runtime.spawn([&] {
+        try {
+            daemon->run();
+        } catch (const std::exception& e) {
+            LOG_ERROR("Lock service stopped: ", e.what());
+            runtime.requestStop();
+        }
+    });
+
+    // Client duoc bao va dong truoc khi nut nha vung gang; khoa dang giu duoc nha truoc khi Comm dung
+    runtime.onShutdown([&] { daemon->waitClosed(); });
+    runtime.onShutdown([&] { lamportNode.shutdown(); });
+    runtime.onShutdown([&] { comm->stop(); });
+
+    return runtime.run();
+}
@@ -1,8 +1,10 @@
-// g++ application/mainLamport.cpp -o application/mainLamport -lpthread -Iframework -Ialgorithm
+// g++ application/mainLamport.cpp -o application/mainLamport -lpthread -lrt -Iframework -Ialgorithm
 
 #include "node.h"
 #include "lamport.h"
+#include "runtime.h"
 #include <iostream>
+#include <sstream>
 #include <thread>
 
 using namespace std;
@@ -16,38 +18,39 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    Runtime runtime;    // Truoc moi luong khac de chung cung chan SIGINT/SIGTERM
+
     logger.setMethods(true, true);
+    logger.setLevel(config.getLogLevel());
     logger.init();
 
     int id = std::stoi(argv[1]);
     std::string ip = config.getNodeIp(id);
     int port = config.getNodePort(id);
-    std::shared_ptr<Comm> comm = std::make_shared<Comm>(port);
+    std::shared_ptr<Comm> comm = std::make_shared<Comm>(id, port);
     LamportNode lamportNode(id, ip, port, comm);
     lamportNode.initialize();
 
-    std::thread([&] {
-        while (1) {
-            lamportNode.receiveLamportMessage();
-        }
-    }).detach();
+    runtime.spawn([&] {
+        while (lamportNode.receiveLamportMessage()) {}
+    });
 
-    std::thread([&] {
-        while (1){
-            int key;
-            std::cin >> key;
+    // Moi so 1 nhap vao la mot lan xin vao vung gang
+    runtime.onLine([&](const std::string& line) {
+        std::istringstream keys(line);
+        int key;
+        while (keys >> key) {
             if (key == 1) {
-                lamportNode.requestCriticalSection();
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                if (lamportNode.canEnterCriticalSection()) {
-                    lamportNode.enterCriticalSection();
-                    lamportNode.releaseCriticalSection();
+                // lock() rut yeu cau khi het thoi gian, lan xin sau khong bi trung
+                if (lamportNode.lock(std::chrono::milliseconds(config.getLeaseTime() + config.getTimeout() + 500))) {
+                    lamportNode.unlock();
                 }
             }
         }
-    }).detach(); 
-        
-    while (1);
+    });
+
+    runtime.onShutdown([&] { lamportNode.shutdown(); });
+    runtime.onShutdown([&] { comm->stop(); });
 
-    return 0;
+    return runtime.run();
 }
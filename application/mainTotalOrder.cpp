@@ -0,0 +1,57 @@
+// g++ application/mainTotalOrder.cpp -o application/mainTotalOrder -lpthread -lrt -Iframework -Ialgorithm
+
+#include "node.h"
+#include "total_order.h"
+#include "runtime.h"
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+Logger logger;
+Config config;
+
+// Moi dong nhap tu stdin la mot cap nhat; "burst N" gui N cap nhat lien tiep de do thong luong
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Please enter ID\n";
+        return 1;
+    }
+
+    Runtime runtime;    // Truoc moi luong khac de chung cung chan SIGINT/SIGTERM
+
+    logger.setMethods(true, true);
+    logger.setLevel(config.getLogLevel());
+    logger.init();
+
+    int id = std::stoi(argv[1]);
+    std::string ip = config.getNodeIp(id);
+    int port = config.getNodePort(id);
+    std::shared_ptr<Comm> comm = std::make_shared<Comm>(id, port);
+    TotalOrderNode node(id, ip, port, comm);
+    size_t delivered = 0;
+    node.setDeliverCallback([&](const LogEntry& entry) {
+        LOG_INFO("Node ", id, " log ", ++delivered, ": from ", entry.senderId, ", Timestamp: ", entry.timestamp, ", ", entry.update);
+    });
+    node.initialize();
+
+    runtime.spawn([&] {
+        while (node.receiveMessage()) {}
+    });
+
+    runtime.onLine([&](const std::string& line) {
+        if (line.compare(0, 6, "burst ") == 0) {
+            int count = std::atoi(line.c_str() + 6);
+            for (int i = 0; i < count; i++) {
+                node.submit("node " + std::to_string(id) + " update " + std::to_string(i));
+            }
+        }
+        else if (!line.empty()) {
+            node.submit(line);
+        }
+    });
+
+    runtime.onShutdown([&] { comm->stop(); });
+
+    return runtime.run();
+}
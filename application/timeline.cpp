@@ -0,0 +1,351 @@
+// g++ application/timeline.cpp -o application/timeline
+//
+// Gộp log của các nút theo đồng hồ Lamport, dựng lại từng vòng vào vùng găng
+// (REQUEST -> REPLY -> enter -> release) và xuất trace JSON cho Chrome/Perfetto.
+//
+// Các nút cần chạy với LOG_LEVEL=DEBUG để log ghi lại từng tin nhắn được gửi.
+//
+// ./application/timeline [--timeline] [--trace trace.json] log1.txt [log2.txt ...]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+
+using namespace std;
+
+enum EventKind { SEND, ENTER, RELEASE_CS };
+
+struct Event {
+    long long wall;      // Thời gian thực (ms) lúc ghi log
+    int timestamp;       // Dấu thời gian Lamport
+    int node;            // Nút ghi ra sự kiện
+    EventKind kind;
+    string type;         // REQUEST, REPLY, RELEASE (chỉ với SEND)
+    int to = 0;          // Nút nhận (chỉ với SEND)
+    string raw;
+};
+
+struct Round {
+    int requester;
+    int requestTs;
+    long long tRequest;
+    set<int> peers;                             // Các nút được gửi REQUEST
+    map<int, pair<long long, int>> replies;     // peer -> (thời gian, Lamport) lúc gửi REPLY
+    long long tEnter = -1;
+    long long tRelease = -1;
+    int enterTs = -1;
+    bool abandoned = false;
+
+    long long lastReply() const {
+        long long t = tRequest;
+        for (auto& r : replies) t = max(t, r.second.first);
+        return t;
+    }
+
+    int slowestPeer() const {
+        int peer = -1;
+        long long t = -1;
+        for (auto& r : replies) {
+            if (r.second.first > t) { t = r.second.first; peer = r.first; }
+        }
+        return peer;
+    }
+};
+
+// "2024-05-01 10:00:00.123 " -> ms
+static bool parseWall(const string& line, long long& wall, size_t& rest) {
+    if (line.size() < 20) return false;
+    tm t = {};
+    istringstream iss(line.substr(0, 19));
+    iss >> get_time(&t, "%Y-%m-%d %H:%M:%S");
+    if (iss.fail()) return false;
+    t.tm_isdst = -1;
+    wall = (long long)mktime(&t) * 1000;
+    rest = 19;
+    if (rest < line.size() && line[rest] == '.') {
+        size_t end = rest + 1;
+        while (end < line.size() && isdigit((unsigned char)line[end])) end++;
+        if (end > rest + 1) wall += stoi(line.substr(rest + 1, min<size_t>(3, end - rest - 1)));
+        rest = end;
+    }
+    while (rest < line.size() && line[rest] == ' ') rest++;
+
+    // Bỏ qua nhãn mức log ("DEBUG ", "INFO ", ...)
+    for (const char* tag : {"TRACE ", "DEBUG ", "INFO ", "WARN ", "ERROR "}) {
+        if (line.compare(rest, strlen(tag), tag) == 0) {
+            rest += strlen(tag);
+            break;
+        }
+    }
+    return true;
+}
+
+static bool fieldInt(const string& s, const string& key, int& value) {
+    size_t pos = s.find(key);
+    if (pos == string::npos) return false;
+    try {
+        value = stoi(s.substr(pos + key.size()));
+    } catch (const exception&) {
+        return false;
+    }
+    return true;
+}
+
+static bool parseLine(const string& line, Event& ev) {
+    size_t rest;
+    if (!parseWall(line, ev.wall, rest)) return false;
+    string body = line.substr(rest);
+    ev.raw = body;
+
+    // "Id: 1, Timestamp: 5, Type: REQUEST, Content: Request CS, To: 2"
+    if (body.compare(0, 4, "Id: ") == 0) {
+        size_t typePos = body.find("Type: ");
+        size_t contentPos = body.find(", Content: ");
+        size_t toPos = body.rfind(", To: ");
+        if (typePos == string::npos || contentPos == string::npos || toPos == string::npos) return false;
+        if (!fieldInt(body, "Id: ", ev.node) || !fieldInt(body, "Timestamp: ", ev.timestamp)) return false;
+        if (!fieldInt(body.substr(toPos), ", To: ", ev.to)) return false;
+        ev.kind = SEND;
+        ev.type = body.substr(typePos + 6, contentPos - (typePos + 6));
+        return true;
+    }
+
+    // "Node 1 enter CS, Timestamp: 7" / "Node 1 release CS, Timestamp: 9"
+    if (body.compare(0, 5, "Node ") == 0) {
+        bool enter = body.find(" enter CS") != string::npos;
+        bool release = body.find(" release CS") != string::npos;
+        if (!enter && !release) return false;
+        if (!fieldInt(body, "Node ", ev.node) || !fieldInt(body, "Timestamp: ", ev.timestamp)) return false;
+        ev.kind = enter ? ENTER : RELEASE_CS;
+        return true;
+    }
+    return false;
+}
+
+static string jsonEscape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            // Ký tự điều khiển (tab, CR, ...) phải viết dạng \u00XX thì JSON mới hợp lệ
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+            out += code;
+        }
+        else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+static double percentile(vector<long long> v, double p) {
+    if (v.empty()) return 0;
+    sort(v.begin(), v.end());
+    size_t idx = (size_t)(p * (v.size() - 1) + 0.5);
+    return (double)v[idx];
+}
+
+int main(int argc, char* argv[]) {
+    bool printTimeline = false;
+    string tracePath;
+    vector<string> files;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--timeline") printTimeline = true;
+        else if (arg == "--trace" && i + 1 < argc) tracePath = argv[++i];
+        else files.push_back(arg);
+    }
+
+    if (files.empty()) {
+        cerr << "Usage: " << argv[0] << " [--timeline] [--trace trace.json] log1.txt [log2.txt ...]\n";
+        return 1;
+    }
+
+    vector<Event> events;
+    for (auto& path : files) {
+        ifstream in(path);
+        if (!in) {
+            cerr << "Cannot open " << path << "\n";
+            return 1;
+        }
+        string line;
+        while (getline(in, line)) {
+            Event ev;
+            if (parseLine(line, ev)) events.push_back(ev);
+        }
+    }
+
+    // Thứ tự Lamport tôn trọng quan hệ nhân quả giữa các nút
+    stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        if (a.timestamp != b.timestamp) return a.timestamp < b.timestamp;
+        if (a.wall != b.wall) return a.wall < b.wall;
+        return a.node < b.node;
+    });
+
+    if (printTimeline) {
+        for (auto& ev : events) {
+            cout << setw(6) << ev.timestamp << "  node " << ev.node << "  " << ev.raw << "\n";
+        }
+        cout << "\n";
+    }
+
+    vector<Round> rounds;
+    map<int, int> openRound; // requester -> chỉ số vòng đang mở
+
+    for (auto& ev : events) {
+        auto it = openRound.find(ev.node);
+        Round* own = (it != openRound.end()) ? &rounds[it->second] : nullptr;
+
+        if (ev.kind == SEND && ev.type == "REQUEST") {
+            if (own && own->tEnter < 0 && !own->peers.count(ev.to)) {
+                own->peers.insert(ev.to);
+                continue;
+            }
+            if (own && own->tEnter < 0) own->abandoned = true;
+            Round r;
+            r.requester = ev.node;
+            r.requestTs = ev.timestamp;
+            r.tRequest = ev.wall;
+            r.peers.insert(ev.to);
+            rounds.push_back(r);
+            openRound[ev.node] = rounds.size() - 1;
+        }
+        else if (ev.kind == SEND && ev.type == "REPLY") {
+            auto target = openRound.find(ev.to);
+            if (target == openRound.end()) continue;
+            Round& r = rounds[target->second];
+            if (r.tEnter < 0 && !r.replies.count(ev.node)) {
+                r.replies[ev.node] = make_pair(ev.wall, ev.timestamp);
+            }
+        }
+        else if (ev.kind == ENTER && own && own->tEnter < 0) {
+            own->tEnter = ev.wall;
+            own->enterTs = ev.timestamp;
+        }
+        else if (ev.kind == RELEASE_CS && own && own->tEnter >= 0) {
+            own->tRelease = ev.wall;
+            openRound.erase(it);
+        }
+    }
+
+    // Báo cáo từng vòng
+    cout << "round requester reqTs replies  acquire(ms) replies(ms) queue(ms) hold(ms) slowest\n";
+    map<int, vector<long long>> acquireByNode;
+    map<int, vector<long long>> replyByPeer;
+    int incomplete = 0;
+
+    for (size_t i = 0; i < rounds.size(); i++) {
+        const Round& r = rounds[i];
+        for (auto& rep : r.replies) replyByPeer[rep.first].push_back(rep.second.first - r.tRequest);
+
+        cout << setw(5) << i << " " << setw(9) << r.requester << " " << setw(5) << r.requestTs << " "
+             << setw(3) << r.replies.size() << "/" << left << setw(3) << r.peers.size() << right;
+
+        if (r.tEnter < 0) {
+            incomplete++;
+            cout << "  " << (r.abandoned ? "abandoned" : "never entered");
+            for (int p : r.peers) {
+                if (!r.replies.count(p)) cout << " (missing REPLY from " << p << ")";
+            }
+            cout << "\n";
+            continue;
+        }
+
+        long long acquire = r.tEnter - r.tRequest;
+        long long replies = r.lastReply() - r.tRequest;
+        long long queue = r.tEnter - r.lastReply();
+        long long hold = r.tRelease >= 0 ? r.tRelease - r.tEnter : 0;
+        acquireByNode[r.requester].push_back(acquire);
+
+        cout << " " << setw(12) << acquire << " " << setw(11) << replies << " " << setw(9) << queue
+             << " " << setw(8) << hold << " " << setw(7) << r.slowestPeer() << "\n";
+    }
+
+    cout << "\nacquire latency per requester (ms)\n";
+    for (auto& e : acquireByNode) {
+        cout << "  node " << e.first << ": n=" << e.second.size() << " p50=" << percentile(e.second, 0.5)
+             << " p99=" << percentile(e.second, 0.99) << " max=" << percentile(e.second, 1.0) << "\n";
+    }
+
+    cout << "\nREPLY latency per peer, measured at the peer's send (ms)\n";
+    for (auto& e : replyByPeer) {
+        cout << "  node " << e.first << ": n=" << e.second.size() << " p50=" << percentile(e.second, 0.5)
+             << " p99=" << percentile(e.second, 0.99) << " max=" << percentile(e.second, 1.0) << "\n";
+    }
+
+    if (incomplete) cout << "\n" << incomplete << " round(s) never entered the critical section\n";
+
+    if (!tracePath.empty()) {
+        ofstream out(tracePath);
+        if (!out) {
+            cerr << "Cannot write " << tracePath << "\n";
+            return 1;
+        }
+
+        long long origin = events.empty() ? 0 : events.front().wall;
+        for (auto& ev : events) origin = min(origin, ev.wall);
+        auto us = [origin](long long wall) { return (wall - origin) * 1000; };
+
+        set<int> nodes;
+        for (auto& ev : events) nodes.insert(ev.node);
+
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto emit = [&](const string& json) {
+            out << (first ? "" : ",\n") << json;
+            first = false;
+        };
+
+        for (int n : nodes) {
+            emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + to_string(n) +
+                 ",\"args\":{\"name\":\"Node " + to_string(n) + "\"}}");
+        }
+
+        auto span = [&](const string& name, int pid, int tid, long long from, long long to, const string& args) {
+            emit("{\"name\":\"" + name + "\",\"ph\":\"X\",\"pid\":" + to_string(pid) + ",\"tid\":" + to_string(tid) +
+                 ",\"ts\":" + to_string(us(from)) + ",\"dur\":" + to_string(us(to) - us(from)) +
+                 ",\"args\":{" + args + "}}");
+        };
+
+        for (size_t i = 0; i < rounds.size(); i++) {
+            const Round& r = rounds[i];
+            string args = "\"round\":" + to_string(i) + ",\"lamport\":" + to_string(r.requestTs) +
+                          ",\"slowest\":" + to_string(r.slowestPeer());
+            if (r.tEnter < 0) {
+                long long end = r.lastReply();
+                span("acquire (never entered)", r.requester, 0, r.tRequest, end, args);
+                continue;
+            }
+            span("acquire", r.requester, 0, r.tRequest, r.tEnter, args);
+            span("wait replies", r.requester, 1, r.tRequest, r.lastReply(), args);
+            span("wait queue", r.requester, 1, r.lastReply(), r.tEnter, args);
+            if (r.tRelease >= 0) span("critical section", r.requester, 0, r.tEnter, r.tRelease, args);
+        }
+
+        for (auto& ev : events) {
+            if (ev.kind != SEND) continue;
+            emit("{\"name\":\"" + ev.type + " -> " + to_string(ev.to) + "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":" +
+                 to_string(ev.node) + ",\"tid\":2,\"ts\":" + to_string(us(ev.wall)) +
+                 ",\"args\":{\"lamport\":" + to_string(ev.timestamp) + ",\"msg\":\"" + jsonEscape(ev.raw) + "\"}}");
+        }
+
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        cout << "\ntrace written to " << tracePath << "\n";
+    }
+
+    return 0;
+}
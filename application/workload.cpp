@@ -0,0 +1,340 @@
+// g++ application/workload.cpp -o application/workload -lpthread -lrt -Iframework -Ialgorithm
+
+#include "node.h"
+#include "lamport.h"
+#include "token.h"
+#include "adaptive.h"
+#include "hierarchical.h"
+#include "runtime.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+Logger logger;
+Config config;
+
+// Bo tao tai: moi tien trinh chay mot nut, tu sinh cac lan xin vung gang theo lich roi ghi ket qua ra CSV.
+// Tai mo (open loop): thoi diem den khong phu thuoc lan truoc da xong chua, lan den muon phai xep hang
+// va thoi gian cho tinh tu luc den, nen do tre khi tranh chap cao khong bi giau di.
+//   workload <id> [--algorithm lamport|token|adaptive|hierarchical] [--pattern poisson|periodic|burst] [--rate R] [--burst N]
+//            [--skew S] [--hold MS] [--hold-dist fixed|exp|uniform] [--duration MS] [--trace FILE]
+//            [--seed N] [--start-at UNIX_MS] [--linger MS] [--timeout MS] [--priority P] [--deadline MS] [--out FILE]
+// --rate: so lan xin moi giay trung binh cua mot nut. --skew S: nut i nhan ti le 1/i^S cua tong tai
+// (S = 0 chia deu). --burst N: moi dot den N yeu cau cung luc, cac dot den theo Poisson.
+// --priority, --deadline: bac uu tien (0..LamportNode::MAX_PRIORITY) va han chot (ms tu luc den) cua moi lan xin, 0 = khong co.
+// --trace: phat lai file vet, moi dong "<thoi diem ms> <nut> <thoi gian giu ms> [uu tien [han chot ms]]",
+// nut chi chay dong cua no; cot khong co thi lay theo --priority/--deadline.
+// CSV: node,seq,arrival_us,granted_us,released_us,wait_us,hold_us,status,priority (thoi gian la micro giay
+// unix, ghep file cua moi nut de kiem tra vung gang khong chong nhau).
+
+struct Options {
+    std::string algorithm = "lamport";
+    std::string pattern = "poisson";
+    double rate = 10;
+    int burst = 10;
+    double skew = 0;
+    double hold = 1;
+    std::string holdDist = "fixed";
+    long duration = 10000;
+    std::string trace;
+    unsigned seed = 0;
+    long long startAt = 0;
+    long linger = 2000;
+    long timeout = 0;
+    int priority = 0;
+    long deadline = 0;
+    std::string out;
+};
+
+struct Arrival {
+    double at;                  // ms tinh tu luc bat dau
+    double hold;                // ms
+    int priority;
+    long deadline;              // ms tinh tu luc den, 0 = khong co
+};
+
+struct Record {
+    int seq;
+    int priority;
+    long long arrival, granted, released;
+    bool ok;
+};
+
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 2; i < argc; i++) {
+        std::string name = argv[i];
+        if (i + 1 >= argc) throw std::runtime_error("Missing value for " + name);
+        std::string value = argv[++i];
+
+        if (name == "--algorithm") options.algorithm = value;
+        else if (name == "--pattern") options.pattern = value;
+        else if (name == "--rate") options.rate = std::stod(value);
+        else if (name == "--burst") options.burst = std::stoi(value);
+        else if (name == "--skew") options.skew = std::stod(value);
+        else if (name == "--hold") options.hold = std::stod(value);
+        else if (name == "--hold-dist") options.holdDist = value;
+        else if (name == "--duration") options.duration = std::stol(value);
+        else if (name == "--trace") options.trace = value;
+        else if (name == "--seed") options.seed = std::stoul(value);
+        else if (name == "--start-at") options.startAt = std::stoll(value);
+        else if (name == "--linger") options.linger = std::stol(value);
+        else if (name == "--timeout") options.timeout = std::stol(value);
+        else if (name == "--priority") options.priority = std::stoi(value);
+        else if (name == "--deadline") options.deadline = std::stol(value);
+        else if (name == "--out") options.out = value;
+        else throw std::runtime_error("Unknown option " + name);
+    }
+
+    if (options.pattern != "poisson" && options.pattern != "periodic" && options.pattern != "burst") {
+        throw std::runtime_error("Unknown pattern " + options.pattern);
+    }
+    if (options.holdDist != "fixed" && options.holdDist != "exp" && options.holdDist != "uniform") {
+        throw std::runtime_error("Unknown hold distribution " + options.holdDist);
+    }
+    if (options.rate <= 0 || options.burst <= 0 || options.hold < 0 || options.duration <= 0) {
+        throw std::runtime_error("rate, burst and duration must be positive, hold must not be negative");
+    }
+    if (options.priority < 0 || options.priority > LamportNode::MAX_PRIORITY || options.deadline < 0) {
+        throw std::runtime_error("priority must be 0.." + std::to_string(LamportNode::MAX_PRIORITY) + ", deadline must not be negative");
+    }
+    return options;
+}
+
+// Lich den tu file vet
+static std::vector<Arrival> loadTrace(const std::string& path, int id, const Options& options) {
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("Cannot open trace " + path);
+
+    std::vector<Arrival> arrivals;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.resize(comment);
+        std::istringstream words(line);
+        double at, hold;
+        int node;
+        int priority = options.priority;
+        long deadline = options.deadline;
+        if (!(words >> at)) continue;
+        if (!(words >> node >> hold)) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": expected <time_ms> <node> <hold_ms>");
+        }
+        if (words >> priority) words >> deadline;
+        if (priority < 0 || priority > LamportNode::MAX_PRIORITY || deadline < 0) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": priority must be 0.." +
+                                     std::to_string(LamportNode::MAX_PRIORITY) + ", deadline must not be negative");
+        }
+        if (node == id) arrivals.push_back({at, hold, priority, deadline});
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [](const Arrival& a, const Arrival& b) { return a.at < b.at; });
+    return arrivals;
+}
+
+// Lich den tong hop theo cac tham so
+static std::vector<Arrival> generate(const Options& options, int id) {
+    int totalNodes = config.getTotalNodes();
+    double share = 1.0;
+    if (options.skew != 0) {
+        double sum = 0;
+        for (int i = 1; i <= totalNodes; i++) sum += std::pow(i, -options.skew);
+        share = totalNodes * std::pow(id, -options.skew) / sum;
+    }
+    double rate = options.rate * share / 1000.0;     // yeu cau moi ms
+
+    std::mt19937_64 random(options.seed * 1000003ULL + id);
+    std::exponential_distribution<double> holdExp(1.0 / std::max(options.hold, 1e-9));
+    std::uniform_real_distribution<double> holdUniform(0, 2 * options.hold);
+    auto holdTime = [&] {
+        if (options.holdDist == "exp") return holdExp(random);
+        if (options.holdDist == "uniform") return holdUniform(random);
+        return options.hold;
+    };
+
+    std::vector<Arrival> arrivals;
+    if (options.pattern == "periodic") {
+        for (double at = 0; at < options.duration; at += 1 / rate) {
+            arrivals.push_back({at, holdTime(), options.priority, options.deadline});
+        }
+    }
+    else {
+        int perArrival = options.pattern == "burst" ? options.burst : 1;
+        std::exponential_distribution<double> gap(rate / perArrival);
+        for (double at = gap(random); at < options.duration; at += gap(random)) {
+            for (int i = 0; i < perArrival; i++) arrivals.push_back({at, holdTime(), options.priority, options.deadline});
+        }
+    }
+    return arrivals;
+}
+
+static std::unique_ptr<DistributedMutex> makeMutex(const std::string& algorithm, int id, std::shared_ptr<Comm> comm) {
+    std::string ip = config.getNodeIp(id);
+    int port = config.getNodePort(id);
+    if (algorithm == "lamport") {
+        auto node = std::make_unique<LamportNode>(id, ip, port, comm);
+        node->initialize();
+        return node;
+    }
+    if (algorithm == "token") {
+        auto node = std::make_unique<TokenNode>(id, ip, port, comm, TokenNode::isInitialHolder(id));
+        node->initialize();
+        return node;
+    }
+    if (algorithm == "adaptive") {
+        return std::make_unique<AdaptiveMutex>(id, ip, port, comm);
+    }
+    if (algorithm == "hierarchical") {
+        return std::make_unique<HierarchicalMutex>(id, ip, port, comm);
+    }
+    throw std::runtime_error("Unknown algorithm " + algorithm);
+}
+
+static long long nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static double percentile(std::vector<long long> values, double p) {
+    if (values.empty()) return 0;
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Please enter ID\n";
+        return 1;
+    }
+
+    Runtime runtime;    // Truoc moi luong khac de chung cung chan SIGINT/SIGTERM
+
+    logger.setMethods(false, true);
+    logger.setLevel(config.getLogLevel());
+    logger.init();
+
+    int id = std::stoi(argv[1]);
+    Options options;
+    std::vector<Arrival> arrivals;
+    try {
+        options = parseOptions(argc, argv);
+        arrivals = options.trace.empty() ? generate(options, id) : loadTrace(options.trace, id, options);
+    } catch (const std::exception& e) {
+        std::cerr << "Workload error: " << e.what() << "\n";
+        return 1;
+    }
+    if (options.out.empty()) options.out = "workload_" + std::to_string(id) + ".csv";
+    if (options.timeout <= 0) options.timeout = config.getLeaseTime() + config.getTimeout() + 500;
+
+    std::shared_ptr<Comm> comm = std::make_shared<Comm>(id, config.getNodePort(id));
+    std::unique_ptr<DistributedMutex> mutex;
+    try {
+        mutex = makeMutex(options.algorithm, id, comm);
+    } catch (const std::exception& e) {
+        std::cerr << "Workload error: " << e.what() << "\n";
+        return 1;
+    }
+
+    runtime.spawn([&] {
+        while (mutex->processMessage()) {}
+    });
+
+    // Lich tinh tu start-at (dong ho he thong, de cac nut chay cung mot vet bat dau cung luc)
+    auto startWall = options.startAt > 0 ? std::chrono::system_clock::time_point(std::chrono::milliseconds(options.startAt))
+                                         : std::chrono::system_clock::now() + std::chrono::seconds(1);
+    auto start = std::chrono::steady_clock::now() + (startWall - std::chrono::system_clock::now());
+
+    // Buoc dung danh thuc luong tai ngay va cho no nha khoa dang giu: mutex->shutdown() nha vung gang
+    // trong khi luong tai con ghi la dang giu thi CSV gop cua cac nut se co hai nut giu khoa cung luc
+    std::mutex sleepMutex;
+    std::condition_variable sleeper;
+    bool stopping = false;
+    bool holding = false;
+
+    runtime.spawn([&] {
+        std::vector<Record> records;
+        records.reserve(arrivals.size());
+        LOG_INFO("Node ", id, " workload: ", arrivals.size(), " requests, algorithm ", options.algorithm);
+
+        auto sleepUntil = [&](std::chrono::steady_clock::time_point until) {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleeper.wait_until(lock, until, [&] { return stopping; });
+        };
+        auto offset = [&](double ms) { return start + std::chrono::microseconds(static_cast<long long>(ms * 1000)); };
+
+        for (size_t i = 0; i < arrivals.size() && !runtime.isStopping(); i++) {
+            auto arrival = offset(arrivals[i].at);
+            sleepUntil(arrival);
+            if (runtime.isStopping()) break;
+
+            Record record;
+            record.seq = i;
+            record.priority = arrivals[i].priority;
+            record.arrival = nowMicros() - std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - arrival).count();
+            // Han chot tinh tu luc den: lan xin den muon (lan truoc chua xong) con it thoi gian hon
+            auto late = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - arrival);
+            auto deadline = arrivals[i].deadline > 0 ? std::max(std::chrono::milliseconds(arrivals[i].deadline) - late, std::chrono::milliseconds(1))
+                                                     : std::chrono::milliseconds(0);
+            record.ok = mutex->lock(std::chrono::milliseconds(options.timeout), arrivals[i].priority, deadline);
+            record.granted = nowMicros();
+            if (record.ok) {
+                {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    holding = true;
+                    sleeper.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long long>(arrivals[i].hold * 1000)),
+                                       [&] { return stopping; });
+                    record.released = nowMicros();
+                    mutex->unlock();
+                    holding = false;
+                }
+                sleeper.notify_all();
+            }
+            else {
+                record.released = record.granted;
+            }
+            records.push_back(record);
+        }
+
+        std::ofstream csv(options.out);
+        csv << "node,seq,arrival_us,granted_us,released_us,wait_us,hold_us,status,priority\n";
+        std::vector<long long> waits;
+        size_t failed = 0;
+        for (const Record& r : records) {
+            csv << id << ',' << r.seq << ',' << r.arrival << ',' << r.granted << ',' << r.released << ','
+                << r.granted - r.arrival << ',' << r.released - r.granted << ',' << (r.ok ? "granted" : "timeout") << ',' << r.priority << '\n';
+            if (r.ok) waits.push_back(r.granted - r.arrival);
+            else failed++;
+        }
+
+        double elapsed = records.empty() ? 0 : (records.back().released - records.front().arrival) / 1e6;
+        std::ostringstream summary;
+        summary << "Node " << id << " workload done: " << waits.size() << " granted, " << failed << " timed out, "
+                << (elapsed > 0 ? waits.size() / elapsed : 0) << " CS/s, wait p50 " << percentile(waits, 0.5) << " ms, p99 "
+                << percentile(waits, 0.99) << " ms, max " << percentile(waits, 1.0) << " ms -> " << options.out;
+        LOG_INFO(summary.str());
+        std::cout << summary.str() << std::endl;
+
+        // Tiep tuc tra loi cac nut khac mot luc roi moi dung
+        sleepUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(options.linger));
+        runtime.requestStop();
+    });
+
+    runtime.onShutdown([&] {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        stopping = true;
+        sleeper.notify_all();
+        sleeper.wait(lock, [&] { return !holding; });
+    });
+    runtime.onShutdown([&] { mutex->shutdown(); });
+    runtime.onShutdown([&] { comm->stop(); });
+
+    return runtime.run();
+}
@@ -3,149 +3,325 @@
 
 #include "config.h"
 #include "log.h"
+#include "transport.h"
+#include "tcp.h"
+#include "shm.h"
+#include "unix.h"
+#include "udp.h"
+#include "failure.h"
+#include "pool.h"
+#include "relay.h"
 #include <string>
-#include <cstring>
-#include <queue>
 #include <mutex>
 #include <map>
-#include <vector>
+#include <set>
 #include <memory>
 #include <condition_variable>
-#include <netinet/in.h>
-#include <thread>
-#include <unistd.h>
-#include <arpa/inet.h>
+#include <exception>
 
 extern Config config;
 extern Logger logger;
 
 class Comm {
 private:
-    int serverSocket;
-    int opt = 1;
-    struct sockaddr_in servaddr;
+    inline static const std::string HEARTBEAT_PREFIX = "HB ";
+
+    int id;
     std::mutex socketMutex;                      
     std::condition_variable messageAvailable;
-    std::queue<std::string> messageQueue; 
-    std::thread receiveThread;
+    MessageRing messageQueue;
+    bool stopped = false;                       // Sau stop() getMessage khong cho nua
+    std::unique_ptr<TcpTransport> tcp;
+    std::unique_ptr<ShmTransport> shm;          // Cho cac nut chay tren cung may
+    std::unique_ptr<UnixTransport> unixSocket;
+    std::unique_ptr<UdpTransport> udp;
+    std::map<int, Transport*> routes;           // id nut dich -> kieu truyen tin
+    std::map<Transport*, std::vector<int>> broadcastGroups;   // Cac nut khac, nhom theo kieu truyen tin
+    std::unique_ptr<BroadcastRelay> relay;      // Luon co de mo phong bi nhan duoc; chi gui theo cay khi BROADCAST_FANOUT > 0
+    std::unique_ptr<FailureDetector> detector;  // Khai bao sau cung de huy truoc cac kenh truyen tin
 
 public:
-    Comm(int port) {
-        if ((serverSocket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-            // std::cerr << "Creating socket failed\n";
-            throw std::runtime_error("Creating socket failed");
+    Comm(int id, int port) : id(id) {
+        Transport::Deliver deliver = [this](std::string&& message) { push(std::move(message)); };
+        tcp = std::make_unique<TcpTransport>(id, port, deliver);
+
+        // Kieu truyen tin cua tung nut dich; nut nay luon nghe theo kieu cua chinh no
+        std::map<int, std::string> modes;
+        std::set<std::string> used;
+        for (const NodeInfo& node : config.getNodes()) {
+            modes[node.id] = resolveTransport(id, node.id);
+            used.insert(modes[node.id]);
         }
 
-        struct sockaddr_in servaddr;
-        memset(&servaddr, 0, sizeof(servaddr));
-        servaddr.sin_family = AF_INET;
-        servaddr.sin_addr.s_addr = INADDR_ANY;
-        servaddr.sin_port = htons(port);
+        std::set<int> localPeers;
+        if (ShmTransport::isLocalAddress(config.getNodeAddress(id))) {
+            for (const NodeInfo& node : config.getNodes()) {
+                if (node.id != id && ShmTransport::isLocalAddress(config.getNodeAddress(node.id))) {
+                    localPeers.insert(node.id);
+                }
+            }
+        }
 
-        if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
-            std::cout << "Loi gan lai socket option!\n";
-            exit(1);
+        if (used.count("shm") && !localPeers.empty()) {
+            shm = std::make_unique<ShmTransport>(id, localPeers, deliver);
+        }
+        if (used.count("unix")) {
+            unixSocket = std::make_unique<UnixTransport>(id, deliver);
+        }
+        if (used.count("udp")) {
+            udp = std::make_unique<UdpTransport>(id, deliver);
         }
 
-        if (bind(serverSocket, (struct sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
-            close(serverSocket);
-            // std::cerr << "Bind failed\n";
-            throw std::runtime_error("Bind failed");
+        for (const NodeInfo& node : config.getNodes()) {
+            const std::string& mode = modes[node.id];
+            if (mode == "shm" && localPeers.count(node.id)) routes[node.id] = shm.get();
+            else if (mode == "unix") routes[node.id] = unixSocket.get();
+            else if (mode == "udp") routes[node.id] = udp.get();
+            else routes[node.id] = tcp.get();
+
+            if (node.id != id) broadcastGroups[routes[node.id]].push_back(node.id);
         }
 
-        if (::listen(serverSocket, 5) < 0) {
-            // std::cerr << "Listen failed\n";
-            throw std::runtime_error("Listen failed");
-            close(serverSocket);
+        // Giu ban sao broadcast du lau de gui lai khi nut con bi nghi ngo (mat toi TIMEOUT + mot chu ky heartbeat)
+        relay = std::make_unique<BroadcastRelay>(id, config.getTotalNodes(), config.getBroadcastFanout(),
+                                                 std::chrono::milliseconds(config.getBroadcastFanout() > 0 ? 2 * config.getTimeout() : 0));
+
+        if (config.getTimeout() > 0) {
+            std::set<int> peers;
+            for (const auto& route : routes) {
+                if (route.first != id) peers.insert(route.first);
+            }
+            detector = std::make_unique<FailureDetector>(peers, std::chrono::milliseconds(config.getTimeout()),
+                                                         [this] { sendHeartbeats(); });
+
+            FailureDetector::Listener listener;
+            listener.onSuspect = [this](int nodeId) {
+                routes.at(nodeId)->setSuspected(nodeId, true);
+                relay->resend([this](const std::vector<int>& next, const std::string& envelope) { relayTo(next, envelope); },
+                              [this](int nodeId) { return isSuspected(nodeId); });
+            };
+            listener.onRecover = [this](int nodeId) { routes.at(nodeId)->setSuspected(nodeId, false); };
+            listener.onTick = [this] {
+                relay->releaseStale(std::chrono::milliseconds(config.getTimeout()),
+                                    [this](std::string&& message) { enqueue(std::move(message)); });
+            };
+            detector->subscribe(listener);
         }
+    }
 
-        receiveThread = std::thread(&Comm::receive, this);
+    // Dang ky nhan thong bao nut bi nghi ngo / song lai; tra ve ma de huy dang ky
+    int subscribe(const FailureDetector::Listener& listener) {
+        return detector ? detector->subscribe(listener) : 0;
     }
 
-    ~Comm() {
-        if (receiveThread.joinable()) {
-            receiveThread.join();
-        }
-        close(serverSocket);
+    void unsubscribe(int token) {
+        if (detector) detector->unsubscribe(token);
+    }
+
+    bool isSuspected(int nodeId) {
+        return detector && detector->isSuspected(nodeId);
+    }
+
+    std::chrono::steady_clock::time_point lastHeard(int nodeId) {
+        return detector ? detector->lastHeardFrom(nodeId) : std::chrono::steady_clock::now();
+    }
+
+    bool anySuspected(const std::vector<int>& nodeIds) {
+        return detector && detector->anySuspected(nodeIds);
     }
 
     void send(int destId, const std::string &message) {
-        auto it = config.getNodeConfigs().find(destId);
+        auto it = routes.find(destId);
 
-        if (it == config.getNodeConfigs().end()) {
+        if (it == routes.end()) {
             std::cout << "Destination ID " << destId << " not found";
             // return;
             throw std::runtime_error("Destination ID " + std::to_string(destId) + " not found");
         }
 
-        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
-        if (clientSocket < 0) {
-            close(clientSocket);
-            // std::cerr << "Failed to create client socket\n";
-            throw std::runtime_error("Failed to create client socket");
+        if (config.getBroadcastFanout() > 0) {
+            static thread_local std::string envelope;
+            relay->wrapDirect(envelope, message);
+            it->second->send(destId, envelope);
+            return;
         }
-
-        sockaddr_in destIp;
-        destIp.sin_family = AF_INET;
-        destIp.sin_port = htons(it->second.second);
-        inet_pton(AF_INET, it->second.first.c_str(), &destIp.sin_addr);
-
-        if (connect(clientSocket, (struct sockaddr*)&destIp, sizeof(destIp)) < 0) {
-            close(clientSocket);
-            // std::cerr << "Failed to connect to destination\n";
-            throw std::runtime_error("Failed to connect to destination");
-        }
-
-        if (::send(clientSocket, message.c_str(), message.size(), 0) < 0) {
-            close(clientSocket);
-            // std::cerr << "Failed to send message\n";
-            throw std::runtime_error("Failed to send message");
-        }
-
-        close(clientSocket);
+        it->second->send(destId, message);
     }
 
-    void receive() {  
-        while (1) {
-            int clientSocket = accept(serverSocket, nullptr, nullptr);
+    // Gui toi moi nut khac (tru nut dang bi nghi ngo); cac nut cung kieu truyen tin duoc gui cung mot dot.
+    // Voi BROADCAST_FANOUT = k > 0 nut nay chi gui cho k nut con, cac nut con chuyen tiep xuong cay.
+    void broadcast(const std::string &message) {
+        if (config.getBroadcastFanout() > 0) {
+            static thread_local std::string envelope;
+            relay->broadcast(envelope, message,
+                             [this](const std::vector<int>& next, const std::string& envelope) { sendToNodes(next, envelope); },
+                             [this](int nodeId) { return isSuspected(nodeId); });
+            return;
+        }
 
-            if (clientSocket >= 0) {
-                char buffer[1024] = {0};
-                int bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-                if (bytesRead < 0) {
-                    close(clientSocket);
-                    // std::cerr << "Failed to receive message\n";
-                    throw std::runtime_error("Failed to receive message");
+        std::exception_ptr error;
+        for (auto& group : broadcastGroups) {
+            try {
+                if (anySuspected(group.second)) {
+                    std::vector<int> alive;
+                    for (int nodeId : group.second) {
+                        if (!isSuspected(nodeId)) alive.push_back(nodeId);
+                    }
+                    if (!alive.empty()) group.first->sendMany(alive, message);
                 }
                 else {
-                    buffer[bytesRead] = '\0';
-                    {
-                        std::lock_guard<std::mutex> lock(socketMutex);
-                        messageQueue.emplace(std::string(buffer));
-                    }
-                    messageAvailable.notify_one();
+                    group.first->sendMany(group.second, message);
                 }
-                close(clientSocket);
+            } catch (...) {
+                if (!error) error = std::current_exception();
             }
-            else {
-                // std::cout << "Error accepting connection\n";
-                throw std::runtime_error("Error accepting connection");
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    // Gui toi mot tap nut (tru nut dang bi nghi ngo), vd cac dai dien nhom cua HierarchicalMutex.
+    // Loi gui toi mot nut khong lam dung viec gui toi cac nut con lai; loi dau tien duoc nem lai
+    void multicast(const std::vector<int>& nodeIds, const std::string& message) {
+        std::exception_ptr error;
+        for (int nodeId : nodeIds) {
+            if (nodeId == id || isSuspected(nodeId)) continue;
+            try {
+                send(nodeId, message);
+            } catch (...) {
+                if (!error) error = std::current_exception();
             }
         }
+        if (error) std::rethrow_exception(error);
     }
 
+    // Chuoi rong khi Comm da dung
     std::string getMessage() {
+        std::string message;
+        getMessage(message);
+        return message;
+    }
+
+    // Nhan vao vung dem cua nguoi goi; vung dem cu cua nguoi goi duoc dung lai cho tin nhan sau.
+    // Tra ve false khi Comm da dung: luong nhan tin ket thuc vong lap
+    bool getMessage(std::string& message) {
         std::unique_lock<std::mutex> lock(socketMutex);
         // while (messageQueue.empty()) {
         //     messageAvailable.wait(lock);  
         // }
 
-        messageAvailable.wait(lock, [this]{ return !messageQueue.empty(); });
+        messageAvailable.wait(lock, [this]{ return !messageQueue.empty() || stopped; });
+        if (stopped) {
+            message.clear();
+            return false;
+        }
+
+        messageQueue.pop(message, messagePool());
+        return true;
+    }
 
-        auto message = messageQueue.front();
-        messageQueue.pop();
+    // Nhu tren nhung chi cho toi until; het han ma chua co tin nhan thi tra ve true voi message rong
+    bool getMessage(std::string& message, std::chrono::steady_clock::time_point until) {
+        std::unique_lock<std::mutex> lock(socketMutex);
+        messageAvailable.wait_until(lock, until, [this]{ return !messageQueue.empty() || stopped; });
+        if (stopped) {
+            message.clear();
+            return false;
+        }
+        if (messageQueue.empty()) {
+            message.clear();
+            return true;
+        }
 
-        return message;
+        messageQueue.pop(message, messagePool());
+        return true;
+    }
+
+    // Danh thuc moi luong dang cho tin nhan; cac kenh truyen tin dong khi Comm bi huy
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(socketMutex);
+            stopped = true;
+        }
+        messageAvailable.notify_all();
+    }
+
+private:
+    // "auto" chon shared memory cho nut cung may (neu SHM_TRANSPORT bat), con lai la TCP.
+    // shm va unix chi dung duoc khi ca hai nut cung may.
+    static std::string resolveTransport(int selfId, int destId) {
+        std::string mode = config.getNodeTransport(destId);
+        bool local = ShmTransport::isLocalAddress(config.getNodeAddress(selfId)) &&
+                     ShmTransport::isLocalAddress(config.getNodeAddress(destId));
+
+        if (mode == "auto") {
+            mode = (config.useSharedMemory() && local) ? "shm" : "tcp";
+        }
+        if ((mode == "shm" || mode == "unix") && !local) {
+            mode = "tcp";
+        }
+        return mode;
+    }
+
+    // Heartbeat di cung kenh voi tin nhan thuong nhung khong vao hang doi tin nhan.
+    // Gui ca toi nut dang bi nghi ngo de nhan ra khi no song lai.
+    void sendHeartbeats() {
+        std::string heartbeat = HEARTBEAT_PREFIX + std::to_string(id);
+        for (const auto& route : routes) {
+            if (route.first == id) continue;
+            try {
+                route.second->sendBestEffort(route.first, heartbeat);
+            } catch (const std::exception& e) {
+                LOG_TRACE("Heartbeat to node ", route.first, " failed: ", e.what());
+            }
+        }
+    }
+
+    // Loi gui toi mot nut khong lam dung viec gui toi cac nut con lai; loi dau tien duoc nem lai
+    void sendToNodes(const std::vector<int>& nodeIds, const std::string& message) {
+        std::exception_ptr error;
+        for (int nodeId : nodeIds) {
+            try {
+                routes.at(nodeId)->send(nodeId, message);
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    // Chuyen tiep broadcast cua nut khac: loi chi ghi log, nut goc khong can biet
+    void relayTo(const std::vector<int>& nodeIds, const std::string& envelope) {
+        try {
+            sendToNodes(nodeIds, envelope);
+        } catch (const std::exception& e) {
+            LOG_WARN("Node ", id, " failed to relay broadcast: ", e.what());
+        }
+    }
+
+    void push(std::string&& message) {
+        if (message.compare(0, HEARTBEAT_PREFIX.size(), HEARTBEAT_PREFIX) == 0) {
+            if (detector) detector->heard(std::atoi(message.c_str() + HEARTBEAT_PREFIX.size()));
+            messagePool().release(std::move(message));
+            return;
+        }
+
+        if (BroadcastRelay::isEnvelope(message)) {
+            relay->receive(std::move(message),
+                           [this](std::string&& payload) { enqueue(std::move(payload)); },
+                           [this](const std::vector<int>& next, const std::string& envelope) { relayTo(next, envelope); },
+                           [this](int nodeId) { return isSuspected(nodeId); });
+            return;
+        }
+
+        enqueue(std::move(message));
+    }
+
+    void enqueue(std::string&& message) {
+        {
+            std::lock_guard<std::mutex> lock(socketMutex);
+            messageQueue.push(std::move(message));
+        }
+        messageAvailable.notify_one();
     }
 
 };
@@ -2,13 +2,26 @@
 #define CONFIG_H
 
 #include "dotenv.h"
+#include "log.h"
+#include "topology.h"
 #include <map>
+#include <vector>
 
 class Config {
 private:
     int totalNodes;
-    // int timeout;
-    std::map<int, std::pair<std::string, int>> nodeConfigs; // cau hinh cho tung node: id - ip - port
+    int timeout;        // thoi gian (ms) khong nhan duoc heartbeat thi nghi ngo node da chet, 0 = tat
+    int leaseTime;      // thoi gian (ms) toi da mot node duoc giu vung gang
+    LogLevel logLevel;
+    bool sharedMemory;  // dung shared memory cho cac node tren cung may
+    bool ioUring;       // dung io_uring cho ket noi TCP/unix (tu quay ve socket thuong neu kernel khong ho tro)
+    int lockBatch;          // so client cua dich vu khoa duoc cap khoa trong mot lan nut vao vung gang
+    int broadcastFanout;    // so nhanh cua cay chuyen tiep broadcast, 0 = gui thang toi moi node
+    int priorityStep;       // so nhip dong ho moi bac uu tien duoc xep truoc (giong nhau o moi node), 0 = bo qua uu tien
+    int priorityGrace;      // thoi gian (ms) toi da giu REPLY cho yeu cau bac thap nhat de yeu cau bac cao vuot, mac dinh TIMEOUT / 2
+    bool adaptiveToken;     // cho AdaptiveMutex doi sang the bai; the mat theo nut chet thi ca cum dung, nen mac dinh tat
+    std::string journalDir; // thu muc chua journal de khoi phuc trang thai khi khoi dong lai, rong = tat
+    Topology topology;  // dia chi, cong, kieu truyen tin (auto, tcp, shm, unix, udp) va nhom cua tung node
 
 public:
     Config() {
@@ -20,47 +33,150 @@ public:
         return totalNodes;
     }
 
-    // int getTimeout() const {
-    //     return timeout;
-    // }
+    LogLevel getLogLevel() const {
+        return logLevel;
+    }
+
+    bool useSharedMemory() const {
+        return sharedMemory;
+    }
+
+    bool useIoUring() const {
+        return ioUring;
+    }
+
+    const std::string& getJournalDir() const {
+        return journalDir;
+    }
+
+    int getTimeout() const {
+        return timeout;
+    }
+
+    int getLeaseTime() const {
+        return leaseTime;
+    }
+
+    int getBroadcastFanout() const {
+        return broadcastFanout;
+    }
+
+    int getPriorityStep() const {
+        return priorityStep;
+    }
+
+    int getPriorityGrace() const {
+        return priorityGrace;
+    }
+
+    int getLockBatch() const {
+        return lockBatch;
+    }
+
+    bool useAdaptiveToken() const {
+        return adaptiveToken;
+    }
 
     std::string getNodeIp(int nodeId) const {
-        auto it = nodeConfigs.find(nodeId);
-        if (it != nodeConfigs.end()) {
-            return it->second.first;
-        }
-        throw std::runtime_error("Node ID " + std::to_string(nodeId) + " not found");
+        in_addr addr = getNodeAddress(nodeId);
+        char ip[INET_ADDRSTRLEN];
+        return inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    }
+
+    in_addr getNodeAddress(int nodeId) const {
+        in_addr addr;
+        addr.s_addr = getNode(nodeId).address;
+        return addr;
     }
 
     int getNodePort(int nodeId) const {
-        auto it = nodeConfigs.find(nodeId);
-        if (it != nodeConfigs.end()) {
-            return it->second.second;
-        }
-        throw std::runtime_error("Node ID " + std::to_string(nodeId) + " not found");
+        return getNode(nodeId).port;
+    }
+
+    std::string getNodeTransport(int nodeId) const {
+        return TRANSPORT_NAMES[getNode(nodeId).transport];
+    }
+
+    int getNodeGroup(int nodeId) const {
+        return getNode(nodeId).group;
+    }
+
+    const std::string& getGroupName(int group) const {
+        return topology.groups.at(group);
     }
 
-    std::map<int, std::pair<std::string, int>> getNodeConfigs() { 
-        return nodeConfigs;
+    // Moi node theo thu tu id, khong sao chep
+    const std::vector<NodeInfo>& getNodes() const {
+        return topology.nodes;
+    }
+
+    const NodeInfo& getNode(int nodeId) const {
+        if (nodeId >= 1 && nodeId <= (int)topology.nodes.size()) {
+            return topology.nodes[nodeId - 1];
+        }
+        throw std::runtime_error("Node ID " + std::to_string(nodeId) + " not found");
     }
     
 private:
     void loadConfigurations() { // tai file cau hinh len
         try {
+            timeout = std::stoi(dotenv::getenv("TIMEOUT", "0"));
+            leaseTime = std::stoi(dotenv::getenv("LEASE_TIME", std::to_string(2 * timeout)));
+            logLevel = parseLogLevel(dotenv::getenv("LOG_LEVEL", "INFO"));
+            sharedMemory = dotenv::getenv("SHM_TRANSPORT", "1") != "0";
+            ioUring = dotenv::getenv("IO_URING", "0") != "0";
+            journalDir = dotenv::getenv("JOURNAL_DIR", "");
+            lockBatch = std::stoi(dotenv::getenv("LOCK_BATCH", "8"));
+            if (lockBatch <= 0) {
+                throw std::runtime_error("LOCK_BATCH must be greater than 0\n");
+            }
+            broadcastFanout = std::stoi(dotenv::getenv("BROADCAST_FANOUT", "0"));
+            if (broadcastFanout < 0) {
+                throw std::runtime_error("BROADCAST_FANOUT must not be negative\n");
+            }
+            adaptiveToken = dotenv::getenv("ADAPTIVE_TOKEN", "0") != "0";
+            priorityStep = std::stoi(dotenv::getenv("PRIORITY_STEP", "0"));
+            if (priorityStep < 0) {
+                throw std::runtime_error("PRIORITY_STEP must not be negative\n");
+            }
+            // Lamport gia dinh an han nho hon TIMEOUT khi tinh le vao vung gang
+            priorityGrace = std::stoi(dotenv::getenv("PRIORITY_GRACE", std::to_string(timeout / 2)));
+            if (priorityGrace < 0 || (timeout > 0 && priorityGrace >= timeout)) {
+                throw std::runtime_error("PRIORITY_GRACE must be between 0 and TIMEOUT\n");
+            }
+
+            // TOPOLOGY: file cau truc cum (xem topology.h); khong co thi doc NODE_i_IP/PORT/TRANSPORT
+            std::string topologyFile = dotenv::getenv("TOPOLOGY", "");
+            if (!topologyFile.empty()) {
+                topology = Topology::load(topologyFile);
+                totalNodes = topology.nodes.size();
+                std::string declared = dotenv::getenv("TOTAL_NODES", "");
+                if (!declared.empty() && std::stoi(declared) != totalNodes) {
+                    throw std::runtime_error("TOTAL_NODES does not match " + topologyFile + "\n");
+                }
+                return;
+            }
+
             totalNodes = std::stoi(dotenv::getenv("TOTAL_NODES"));
-            // timeout = std::stoi(dotenv::getenv("TIMEOUT"));
             if (totalNodes <= 0) {
                 throw std::runtime_error("TOTAL_NODES must be greater than 0\n");
             }
 
+            topology.nodes.reserve(totalNodes);
             for (int i = 1; i <= totalNodes; i++) {
                 std::string ip = dotenv::getenv(("NODE_" + std::to_string(i) + "_IP").c_str());
                 int port = std::stoi(dotenv::getenv(("NODE_" + std::to_string(i) + "_PORT").c_str()));
-                if (ip.empty() || port <= 0 || port > 65535) {
+                in_addr addr;
+                if (inet_pton(AF_INET, ip.c_str(), &addr) != 1 || port <= 0 || port > 65535) {
                     throw std::runtime_error("Invalid address or port for node " + std::to_string(i) + "\n");
                 }
 
-                nodeConfigs[i] = std::make_pair(ip, port);
+                int transport = parseTransport(dotenv::getenv(("NODE_" + std::to_string(i) + "_TRANSPORT").c_str(), "auto"));
+                if (transport < 0) {
+                    throw std::runtime_error("Invalid transport for node " + std::to_string(i) + "\n");
+                }
+
+                topology.nodes.push_back(NodeInfo{i, addr.s_addr, (uint16_t)port, (uint8_t)transport, 0, 0, 0});
             }
         }
         catch (const std::exception &e) {
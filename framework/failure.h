@@ -0,0 +1,158 @@
+#ifndef FAILURE_H
+#define FAILURE_H
+
+#include "log.h"
+#include <map>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+extern Logger logger;
+
+// Phat hien nut loi bang heartbeat: moi chu ky gui heartbeat toi cac nut khac, nut nao
+// im lang qua timeout thi bi nghi ngo; nghe lai duoc tu nut do thi bo nghi ngo.
+class FailureDetector {
+public:
+    struct Listener {
+        std::function<void(int)> onSuspect;   // Nut bi nghi ngo da chet
+        std::function<void(int)> onRecover;   // Nut bi nghi ngo gui heartbeat tro lai
+        std::function<void()> onTick;         // Goi moi chu ky heartbeat (kiem tra lease, ...)
+    };
+
+private:
+    std::chrono::milliseconds timeout;
+    std::chrono::milliseconds interval;
+    std::function<void()> sendHeartbeats;
+    std::mutex mutex;
+    std::condition_variable stopRequested;
+    bool running = true;
+    std::map<int, std::chrono::steady_clock::time_point> lastHeard;
+    std::set<int> suspected;
+    std::map<int, Listener> listeners;
+    int nextListener = 1;
+    std::thread thread;
+
+public:
+    FailureDetector(const std::set<int>& peers, std::chrono::milliseconds timeout, std::function<void()> sendHeartbeats)
+        : timeout(timeout), interval(std::max<std::chrono::milliseconds>(timeout / 5, std::chrono::milliseconds(1))),
+          sendHeartbeats(sendHeartbeats) {
+        auto now = std::chrono::steady_clock::now();
+        for (int peer : peers) {
+            lastHeard[peer] = now;
+        }
+        thread = std::thread(&FailureDetector::run, this);
+    }
+
+    ~FailureDetector() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        stopRequested.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    std::chrono::milliseconds getTimeout() const {
+        return timeout;
+    }
+
+    int subscribe(const Listener& listener) {
+        std::lock_guard<std::mutex> lock(mutex);
+        listeners[nextListener] = listener;
+        return nextListener++;
+    }
+
+    void unsubscribe(int token) {
+        std::lock_guard<std::mutex> lock(mutex);
+        listeners.erase(token);
+    }
+
+    void heard(int nodeId) {
+        std::vector<Listener> toNotify;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lastHeard[nodeId] = std::chrono::steady_clock::now();
+            if (suspected.erase(nodeId)) {
+                toNotify = snapshot();
+            }
+        }
+
+        if (!toNotify.empty()) {
+            LOG_INFO("Node ", nodeId, " is alive again");
+        }
+        for (auto& listener : toNotify) {
+            if (listener.onRecover) listener.onRecover(nodeId);
+        }
+    }
+
+    // Lan cuoi nghe thay nut do (luc khoi dong neu chua bao gio nghe thay)
+    std::chrono::steady_clock::time_point lastHeardFrom(int nodeId) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = lastHeard.find(nodeId);
+        return it != lastHeard.end() ? it->second : std::chrono::steady_clock::now();
+    }
+
+    bool isSuspected(int nodeId) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return suspected.count(nodeId) > 0;
+    }
+
+    bool anySuspected(const std::vector<int>& nodeIds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (suspected.empty()) return false;
+        for (int nodeId : nodeIds) {
+            if (suspected.count(nodeId)) return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<Listener> snapshot() const {
+        std::vector<Listener> result;
+        for (auto& entry : listeners) {
+            result.push_back(entry.second);
+        }
+        return result;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            stopRequested.wait_for(lock, interval, [this] { return !running; });
+            if (!running) break;
+
+            lock.unlock();
+            sendHeartbeats();
+            lock.lock();
+
+            auto now = std::chrono::steady_clock::now();
+            std::vector<int> newlySuspected;
+            for (auto& entry : lastHeard) {
+                if (now - entry.second > timeout && suspected.insert(entry.first).second) {
+                    newlySuspected.push_back(entry.first);
+                }
+            }
+            std::vector<Listener> toNotify = snapshot();
+
+            lock.unlock();
+            for (int nodeId : newlySuspected) {
+                LOG_WARN("Node ", nodeId, " suspected: no heartbeat for ", timeout.count(), " ms");
+                for (auto& listener : toNotify) {
+                    if (listener.onSuspect) listener.onSuspect(nodeId);
+                }
+            }
+            for (auto& listener : toNotify) {
+                if (listener.onTick) listener.onTick();
+            }
+            lock.lock();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "log.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern Logger logger;
+
+// Journal chi ghi them, anh xa vao bo nho: moi ban ghi la mot thao tac memcpy, khong co syscall.
+// Du lieu trong page cache van con khi tien trinh bi giet, nen nut khoi dong lai doc duoc ngay.
+// Khi journal day, trang thai hien tai duoc ghi thanh snapshot (file tam + rename) va journal ghi lai tu dau.
+class Journal {
+public:
+    struct State {
+        int clock = 0;                                  // Dong ho khong nho hon moi gia tri da dung truoc khi chet
+        std::map<std::pair<int, int>, int> requests;    // (senderId, timestamp) -> bac uu tien, trong hang doi yeu cau
+    };
+
+private:
+    enum RecordType : uint8_t { CLOCK = 1, PUSH = 2, REMOVE = 3 };
+
+    struct Header {
+        uint64_t magic;
+        uint64_t generation;                            // Tang moi lan snapshot; ban ghi cu hon bi bo qua
+    };
+
+    struct Record {
+        uint8_t type;
+        uint8_t pad[3];                                 // pad[0]: bac uu tien cua ban ghi PUSH
+        int32_t senderId;
+        int32_t value;
+        uint32_t check;
+    };
+
+    static constexpr uint64_t MAGIC = 0x4c4d504f524a4e4cULL;
+    static constexpr uint64_t SNAPSHOT_MAGIC = MAGIC + 1;   // Snapshot co bac uu tien; snapshot MAGIC cu chi co cap (senderId, timestamp)
+    static constexpr size_t CAPACITY = 1 << 16;         // So ban ghi truoc khi snapshot
+    static constexpr int CLOCK_BLOCK = 1024;            // Dat truoc dong ho theo khoi, moi khoi mot ban ghi
+
+    std::string path;
+    int fd = -1;
+    char* base = (char*)MAP_FAILED;
+    size_t size;
+    uint64_t generation = 0;
+    size_t next = 0;                                    // Vi tri ban ghi tiep theo
+    std::atomic<int> reserved{0};                       // Dong ho da dat truoc toi gia tri nay
+    State state;                                        // Ban sao trang thai de viet snapshot
+    std::mutex mutex;
+
+public:
+    explicit Journal(const std::string& path) : path(path), size(sizeof(Header) + CAPACITY * sizeof(Record)) {
+        std::string dir = path.substr(0, path.find_last_of('/'));
+        if (dir != path) {
+            mkdir(dir.c_str(), 0755);
+        }
+
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 || ftruncate(fd, size) < 0) {
+            if (fd >= 0) close(fd);
+            throw std::runtime_error("Failed to open journal " + path);
+        }
+        base = static_cast<char*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        if (base == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map journal " + path);
+        }
+    }
+
+    ~Journal() {
+        if (base != MAP_FAILED) munmap(base, size);
+        if (fd >= 0) close(fd);
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Doc snapshot roi ap dung cac ban ghi cung the he; goi mot lan truoc moi thao tac ghi
+    State recover() {
+        std::lock_guard<std::mutex> lock(mutex);
+        state = State();
+        generation = loadSnapshot();
+
+        Header header;
+        memcpy(&header, base, sizeof(header));
+        next = 0;
+        if (header.magic == MAGIC && header.generation > generation) {
+            // Journal da qua snapshot ma file snapshot mat: khong the biet dong ho da dung toi dau
+            throw std::runtime_error("Journal " + path + " is at generation " + std::to_string(header.generation) +
+                                     " but its snapshot is missing; remove the journal files to start fresh");
+        }
+        if (header.magic == MAGIC && header.generation == generation) {
+            while (next < CAPACITY) {
+                Record record;
+                memcpy(&record, recordAt(next), sizeof(record));
+                if (record.check != checksum(record)) break;
+                apply(record);
+                next++;
+            }
+        }
+        else {
+            // Journal cu hon snapshot (chet giua luc snapshot) hoac chua co: bat dau the he moi
+            writeHeader();
+        }
+
+        // Moi gia tri dong ho da dung deu nho hon gioi han da dat truoc
+        reserved = state.clock;
+        return state;
+    }
+
+    // Goi sau moi lan dong ho tang; chi ghi khi vuot qua khoi da dat truoc
+    void observeClock(int timestamp) {
+        if (timestamp < reserved.load(std::memory_order_relaxed)) return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (timestamp < reserved.load()) return;
+        int bound = timestamp + CLOCK_BLOCK;
+        append({CLOCK, {0, 0, 0}, 0, bound, 0});
+        reserved = bound;
+    }
+
+    void push(int senderId, int timestamp, int priority = 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        append({PUSH, {static_cast<uint8_t>(priority), 0, 0}, senderId, timestamp, 0});
+    }
+
+    // Xoa moi yeu cau cua mot nut, giong LamportNode::removeRequest
+    void remove(int senderId) {
+        std::lock_guard<std::mutex> lock(mutex);
+        append({REMOVE, {0, 0, 0}, senderId, 0, 0});
+    }
+
+private:
+    char* recordAt(size_t index) const {
+        return base + sizeof(Header) + index * sizeof(Record);
+    }
+
+    uint32_t checksum(const Record& record) const {
+        uint64_t h = MAGIC ^ (generation * 0x9e3779b97f4a7c15ULL);
+        h ^= record.type | static_cast<uint32_t>(record.pad[0]) << 8;   // Ban ghi cu (pad = 0) van hop le
+        h = h * 0x100000001b3ULL ^ static_cast<uint32_t>(record.senderId);
+        h = h * 0x100000001b3ULL ^ static_cast<uint32_t>(record.value);
+        h *= 0x100000001b3ULL;
+        uint32_t check = static_cast<uint32_t>(h ^ (h >> 32));
+        return check ? check : 1;                       // Vung chua ghi (toan so 0) khong bao gio hop le
+    }
+
+    void apply(const Record& record) {
+        switch (record.type) {
+            case CLOCK:
+                state.clock = std::max(state.clock, record.value);
+                break;
+            case PUSH:
+                state.requests[{record.senderId, record.value}] = record.pad[0];
+                break;
+            case REMOVE:
+                state.requests.erase(state.requests.lower_bound({record.senderId, INT32_MIN}),
+                                     state.requests.lower_bound({record.senderId + 1, INT32_MIN}));
+                break;
+        }
+    }
+
+    // Goi khi dang giu mutex
+    // Ap dung truoc khi snapshot: neu snapshot loi, trang thai van giu ban ghi cho lan snapshot sau
+    void append(Record record) {
+        apply(record);
+        if (next == CAPACITY) {
+            compact();
+        }
+        record.check = checksum(record);
+        memcpy(recordAt(next++), &record, sizeof(record));
+    }
+
+    void writeHeader() {
+        Header header = {MAGIC, generation};
+        memcpy(base, &header, sizeof(header));
+    }
+
+    // Snapshot: magic, the he, dong ho, so yeu cau, roi tung bo (senderId, timestamp, uu tien)
+    void compact() {
+        uint64_t nextGeneration = generation + 1;
+        std::vector<int64_t> data = {static_cast<int64_t>(SNAPSHOT_MAGIC), static_cast<int64_t>(nextGeneration),
+                                     state.clock, static_cast<int64_t>(state.requests.size())};
+        for (const auto& request : state.requests) {
+            data.push_back(request.first.first);
+            data.push_back(request.first.second);
+            data.push_back(request.second);
+        }
+
+        std::string temp = path + ".snap.tmp";
+        int snap = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        bool ok = snap >= 0 && write(snap, data.data(), data.size() * sizeof(int64_t)) == (ssize_t)(data.size() * sizeof(int64_t)) &&
+                  fsync(snap) == 0;
+        if (snap >= 0) close(snap);
+        if (!ok || rename(temp.c_str(), (path + ".snap").c_str()) < 0) {
+            unlink(temp.c_str());
+            throw std::runtime_error("Failed to write journal snapshot " + temp);
+        }
+
+        // Snapshot da an toan: ban ghi the he cu trong journal tu bi bo qua
+        generation = nextGeneration;
+        writeHeader();
+        next = 0;
+        LOG_DEBUG("Journal ", path, " compacted, generation ", generation, ", ", state.requests.size(), " requests");
+    }
+
+    uint64_t loadSnapshot() {
+        int snap = open((path + ".snap").c_str(), O_RDONLY | O_CLOEXEC);
+        if (snap < 0) return 0;
+
+        std::vector<int64_t> data;
+        int64_t buffer[512];
+        ssize_t n;
+        while ((n = read(snap, buffer, sizeof(buffer))) > 0) {
+            data.insert(data.end(), buffer, buffer + n / sizeof(int64_t));
+        }
+        close(snap);
+
+        // Snapshot truoc khi co bac uu tien: moi yeu cau hai truong, bac uu tien 0
+        size_t fields = (data.size() >= 4 && static_cast<uint64_t>(data[0]) == MAGIC) ? 2 : 3;
+        if (data.size() < 4 || (fields == 3 && static_cast<uint64_t>(data[0]) != SNAPSHOT_MAGIC) ||
+            data[3] < 0 || data.size() != 4 + fields * static_cast<size_t>(data[3])) {
+            // Bo qua snapshot se dua dong ho ve 0 va dung lai timestamp cu: tu choi khoi dong
+            throw std::runtime_error("Journal snapshot " + path + ".snap is corrupt; remove the journal files to start fresh");
+        }
+        state.clock = static_cast<int>(data[2]);
+        for (size_t i = 4; i < data.size(); i += fields) {
+            state.requests[{static_cast<int>(data[i]), static_cast<int>(data[i + 1])}] = fields == 3 ? static_cast<int>(data[i + 2]) : 0;
+        }
+        return static_cast<uint64_t>(data[1]);
+    }
+};
+
+#endif
@@ -11,12 +11,42 @@
 #include <thread>
 #include <sstream>
 #include <iomanip>
+#include <atomic>
+#include <algorithm>
+
+// Mức log nhỏ hơn ngưỡng này bị loại bỏ ngay lúc biên dịch (vd: -DLOG_COMPILE_LEVEL=2 bỏ TRACE và DEBUG)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 0
+#endif
+
+enum class LogLevel { Trace, Debug, Info, Warn, Error, Off };
+
+inline const char* logLevelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Trace: return "TRACE";
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info:  return "INFO";
+        case LogLevel::Warn:  return "WARN";
+        case LogLevel::Error: return "ERROR";
+        default:              return "OFF";
+    }
+}
+
+// "DEBUG", "info", ... -> LogLevel, mặc định là Info nếu không nhận ra
+inline LogLevel parseLogLevel(std::string name) {
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+    for (int l = static_cast<int>(LogLevel::Trace); l <= static_cast<int>(LogLevel::Off); l++) {
+        if (name == logLevelName(static_cast<LogLevel>(l))) return static_cast<LogLevel>(l);
+    }
+    return LogLevel::Info;
+}
 
 class LoggingMethod {
 public:
     virtual ~LoggingMethod() {}
     virtual void init() {}
     virtual void clean() {}
+    virtual void flush() {}
     virtual void log(const std::string& s) = 0;
     
     std::string getCurrentTime() {  // Lấy thời gian hiện tại để thêm vào log
@@ -25,8 +55,10 @@ public:
         std::tm localTime;
         localtime_r(&time, &localTime); // Sử dụng localtime_r cho Linux
 
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+
         std::ostringstream oss;
-        oss << std::put_time(&localTime, "%Y-%m-%d %H:%M:%S ");
+        oss << std::put_time(&localTime, "%Y-%m-%d %H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << ms << ' ';
         
         return oss.str();
     }
@@ -50,16 +82,19 @@ protected:
     bool closed = false;
     std::mutex mutex;
     std::condition_variable cond;
+    std::thread writer;
 
 public:
     void init() override {
+        std::unique_lock lock(mutex);
         if (file.is_open()) file.close();
         file.open("log.txt", std::ios::out | std::ios::app);
         if (!file) {
             std::cout << "Failed to create file log\n" << std::endl;
             return;
         }
-        std::thread([this]() {
+        if (writer.joinable()) return;
+        writer = std::thread([this]() {
             do {
                 std::unique_lock lock(mutex);
                 cond.wait(lock, [this]() { return !queue.empty() || closed; });
@@ -70,21 +105,35 @@ public:
                     queue.pop_front();
                 }
             } while (!closed);
-        }).detach();
+        });
     }
 
     ~FileLoggingMethod() override {
-        closed = true;
-        cond.notify_one();
+        flush();
     }
 
     void clean() override {
+        std::unique_lock lock(mutex);
         if (file.is_open()) file.close();
     }
 
+    // Ghi hết hàng đợi rồi dừng luồng ghi; các bản ghi sau đó được ghi thẳng
+    void flush() override {
+        {
+            std::unique_lock lock(mutex);
+            closed = true;
+        }
+        cond.notify_one();
+        if (writer.joinable()) writer.join();
+    }
+
     void log(const std::string& s) override {
-        if (!file.is_open()) return;
         std::unique_lock lock(mutex);
+        if (!file.is_open()) return;
+        if (closed) {
+            file << formatMessage(s) << std::endl;
+            return;
+        }
         queue.push_back(formatMessage(s));
         cond.notify_one();
     }
@@ -94,6 +143,7 @@ class Logger {
 protected:
     bool toConsole = true;
     bool toFile = true;
+    std::atomic<int> level{static_cast<int>(LogLevel::Info)};
     std::list<std::shared_ptr<LoggingMethod>> methods;
 
 public:
@@ -102,6 +152,14 @@ public:
         toFile = file;
     }
 
+    void setLevel(LogLevel l) {
+        level.store(static_cast<int>(l), std::memory_order_relaxed);
+    }
+
+    bool isEnabled(LogLevel l) const {
+        return static_cast<int>(l) >= level.load(std::memory_order_relaxed);
+    }
+
     void init() {
         if (toConsole) methods.push_back(std::make_shared<ConsoleLoggingMethod>());
         if (toFile) methods.push_back(std::make_shared<FileLoggingMethod>());
@@ -119,10 +177,40 @@ public:
             m->log(msg);
         }
     }
+
+    // Gọi khi tiến trình sắp kết thúc để không mất bản ghi còn trong hàng đợi
+    void flush() {
+        for (auto& m : methods) {
+            m->flush();
+        }
+    }
+
+    // Chỉ định dạng bản ghi khi đã chắc chắn nó được ghi ra (gọi qua các macro LOG_*)
+    template <typename... Args>
+    void write(LogLevel l, const Args&... args) {
+        std::ostringstream oss;
+        oss << logLevelName(l) << ' ';
+        (oss << ... << args);
+        log(oss.str());
+    }
 };
 
 extern Logger logger;
 
+// Các đối số chỉ được tính khi mức log được bật cả lúc biên dịch lẫn lúc chạy
+#define LOG_AT(lvl, ...)                                                    \
+    do {                                                                    \
+        if constexpr (static_cast<int>(lvl) >= LOG_COMPILE_LEVEL) {         \
+            if (logger.isEnabled(lvl)) logger.write(lvl, __VA_ARGS__);      \
+        }                                                                   \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+
 
 
 
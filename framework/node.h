@@ -31,12 +31,12 @@ public:
     }
   
     ~Node() {
-        logger.log("Node " + std::to_string(id) + " closed");
+        LOG_INFO("Node ", id, " closed");
     }
 
     void initialize() {
         // setState(NodeState::ACTIVE);
-        logger.log("Node " + std::to_string(id) + " created");
+        LOG_INFO("Node ", id, " created");
     }
 
     // int getId() const { 
@@ -0,0 +1,95 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+// Kho vung dem tin nhan dung lai: kenh truyen tin lay vung dem de chep tin nhan nhan duoc,
+// nut xu ly xong tra lai. Chuoi da clear() van giu dung luong nen o trang thai on dinh
+// khong con cap phat bo nho cho moi tin nhan.
+class MessagePool {
+private:
+    static constexpr size_t MAX_FREE = 1024;            // Giu toi da bay nhieu vung dem ranh
+    static constexpr size_t MIN_CAPACITY = 32;          // Chuoi ngan nam trong doi tuong (SSO), khong can giu
+    static constexpr size_t MAX_CAPACITY = 64 * 1024;   // Vung dem lon hon thi tra cho he thong
+
+    std::mutex mutex;
+    std::vector<std::string> free;
+
+public:
+    MessagePool() {
+        free.reserve(MAX_FREE);
+    }
+
+    std::string acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free.empty()) {
+            return std::string();
+        }
+        std::string buffer = std::move(free.back());
+        free.pop_back();
+        return buffer;
+    }
+
+    // Chep du lieu vao mot vung dem lay tu kho
+    std::string acquire(const char* data, size_t size) {
+        std::string buffer = acquire();
+        buffer.assign(data, size);
+        return buffer;
+    }
+
+    void release(std::string&& buffer) {
+        if (buffer.capacity() < MIN_CAPACITY || buffer.capacity() > MAX_CAPACITY) return;
+        buffer.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free.size() < MAX_FREE) {
+            free.push_back(std::move(buffer));
+        }
+    }
+};
+
+// Hang doi vong cac tin nhan: o nho duoc dung lai, chi cap phat khi phai mo rong
+class MessageRing {
+private:
+    std::vector<std::string> slots;
+    size_t head = 0;
+    size_t count = 0;
+
+public:
+    explicit MessageRing(size_t capacity = 256) : slots(capacity) {}
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void push(std::string&& message) {
+        if (count == slots.size()) {
+            std::vector<std::string> larger(slots.size() * 2);
+            for (size_t i = 0; i < count; i++) {
+                larger[i] = std::move(slots[(head + i) % slots.size()]);
+            }
+            slots.swap(larger);
+            head = 0;
+        }
+        slots[(head + count) % slots.size()] = std::move(message);
+        count++;
+    }
+
+    // Doi tin nhan dau hang lay vung dem cu cua nguoi goi, vung dem cu duoc tra ve kho
+    void pop(std::string& message, MessagePool& pool) {
+        std::string& slot = slots[head];
+        message.swap(slot);
+        pool.release(std::move(slot));
+        head = (head + 1) % slots.size();
+        count--;
+    }
+};
+
+// Kho dung chung cho moi kenh truyen tin va moi nut trong tien trinh
+inline MessagePool& messagePool() {
+    static MessagePool pool;
+    return pool;
+}
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include "pool.h"
+#include "log.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <charconv>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <unistd.h>
+
+extern Logger logger;
+
+// Phat tan tin nhan broadcast theo cay k-nhanh goc tai nut gui: nut co hang r (tinh tu nut goc)
+// chuyen tiep cho cac nut hang k*r+1 .. k*r+k, moi nut chi gui toi da k lan.
+//   "B|<goc>|<lan chay>|<so thu tu>|<noi dung>"   tin nhan broadcast
+//   "D|<goc>|<lan chay>|<so broadcast>|<noi dung>" tin nhan gui thang, kem so broadcast cuoi cung nut goc da gui
+// Broadcast cua moi nut goc duoc giao theo dung so thu tu, tin nhan gui thang chi duoc giao sau broadcast
+// ma no mang theo, nen thu tu FIFO giua hai nut van dung du tin nhan di vong qua cay (thuat toan Lamport can dieu nay).
+class BroadcastRelay {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Held {
+        uint32_t seq;
+        size_t headerSize;
+        std::string message;
+        Clock::time_point since;
+    };
+
+    struct Origin {
+        uint32_t epoch = 0;
+        uint32_t delivered = 0;                                 // Da giao moi broadcast co so thu tu <= gia tri nay
+        std::map<uint32_t, Held> pending;                       // Broadcast den som, doi broadcast truoc no
+        std::deque<Held> held;                                  // Tin nhan gui thang dang doi broadcast
+    };
+
+    struct Sent {
+        int origin;
+        std::string envelope;
+        Clock::time_point at;
+    };
+
+    int id;
+    int totalNodes;
+    int fanout;
+    uint32_t epoch;
+    std::chrono::milliseconds resendWindow;                     // 0 = khong giu ban sao de gui lai
+    std::atomic<uint32_t> lastSeq{0};
+    std::mutex mutex;
+    std::map<int, Origin> origins;
+    std::deque<Sent> recent;                                    // Broadcast nut nay vua gui/chuyen tiep
+
+public:
+    using Deliver = std::function<void(std::string&&)>;
+    using Relay = std::function<void(const std::vector<int>&, const std::string&)>;
+    using Suspected = std::function<bool(int)>;
+
+    BroadcastRelay(int id, int totalNodes, int fanout, std::chrono::milliseconds resendWindow)
+        : id(id), totalNodes(totalNodes), fanout(fanout), resendWindow(resendWindow) {
+        epoch = static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count()) ^ getpid();
+        if (epoch == 0) epoch = 1;                                  // 0 danh cho nut goc chua biet
+    }
+
+    static bool isEnvelope(const std::string& message) {
+        return message.size() > 2 && (message[0] == 'B' || message[0] == 'D') && message[1] == '|';
+    }
+
+    // Dong goi broadcast moi cua chinh nut nay roi gui cho cac nut con
+    void broadcast(std::string& envelope, const std::string& payload, const Relay& relay, const Suspected& suspected) {
+        std::lock_guard<std::mutex> lock(mutex);
+        writeHeader(envelope, 'B', ++lastSeq);
+        envelope += payload;
+        forward(id, envelope, relay, suspected);
+    }
+
+    void wrapDirect(std::string& out, const std::string& payload) {
+        writeHeader(out, 'D', lastSeq.load());
+        out += payload;
+    }
+
+    // Cac nut con cua nut co hang rank trong cay goc origin; con bi nghi ngo da chet thi nhan
+    // thang cac con cua no
+    void children(int origin, int rank, const Suspected& suspected, std::vector<int>& out) const {
+        for (long child = (long)fanout * rank + 1; child <= (long)fanout * rank + fanout && child < totalNodes; child++) {
+            int nodeId = nodeAt(origin, child);
+            if (suspected(nodeId)) {
+                children(origin, child, suspected, out);
+            }
+            else {
+                out.push_back(nodeId);
+            }
+        }
+    }
+
+    int rankOf(int origin, int nodeId) const {
+        return (nodeId - origin + totalNodes) % totalNodes;
+    }
+
+    // Xu ly mot phong bi nhan duoc: chuyen tiep broadcast xuong cay, bo ban trung, giao noi dung theo thu tu
+    void receive(std::string&& message, const Deliver& deliver, const Relay& relay, const Suspected& suspected) {
+        char kind = message[0];
+        int origin;
+        uint32_t messageEpoch, seq;
+        size_t headerSize;
+        if (!parseHeader(message, origin, messageEpoch, seq, headerSize) || origin > totalNodes || origin == id) return;
+
+        std::vector<std::string> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Origin& state = origins[origin];
+            if (state.epoch == 0) {
+                // Lan dau nghe tu nut goc nay (nut nay vua khoi dong hoac nut goc moi): cac broadcast truoc do
+                // da gui truoc khi nut nay chay, khong cho chung ma bat dau tu tin nhan nay
+                state.epoch = messageEpoch;
+                state.delivered = (kind == 'D') ? seq : seq - 1;
+            }
+            else if (state.epoch != messageEpoch) {
+                // Nut goc vua khoi dong lai: so thu tu bat dau lai tu 1
+                state = Origin();
+                state.epoch = messageEpoch;
+            }
+
+            if (kind == 'D') {
+                if (seq > state.delivered || !state.held.empty()) {
+                    state.held.push_back({seq, headerSize, std::move(message), Clock::now()});
+                    return;
+                }
+                message.erase(0, headerSize);
+                ready.push_back(std::move(message));
+            }
+            else {
+                if (seq <= state.delivered || state.pending.count(seq)) return;     // Ban trung
+
+                forward(origin, message, relay, suspected);
+                state.pending.emplace(seq, Held{seq, headerSize, std::move(message), Clock::now()});
+                drain(state, ready);
+            }
+        }
+
+        for (auto& payload : ready) {
+            deliver(std::move(payload));
+        }
+    }
+
+    // Mot nut vua bi nghi ngo: broadcast gui cho no gan day co the da mat, gui lai cho cac nut
+    // nhan thay no. Nut nhan bo qua ban da co.
+    void resend(const Relay& relay, const Suspected& suspected) {
+        std::lock_guard<std::mutex> lock(mutex);
+        prune();
+        std::vector<int> next;
+        for (const Sent& sent : recent) {
+            next.clear();
+            children(sent.origin, rankOf(sent.origin, id), suspected, next);
+            if (!next.empty()) relay(next, sent.envelope);
+        }
+    }
+
+    // Broadcast bi mat han (vd nut chuyen tiep chet truoc khi kip gui lai, hoac nut nay bi nghi ngo nen
+    // bi bo qua luc gui) thi khong cho nua: bo qua cac so con thieu cua tin nhan da doi qua maxAge
+    void releaseStale(std::chrono::milliseconds maxAge, const Deliver& deliver) {
+        std::vector<std::string> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto deadline = Clock::now() - maxAge;
+            for (auto& entry : origins) {
+                Origin& state = entry.second;
+                uint32_t skipTo = state.delivered;
+                if (!state.pending.empty() && state.pending.begin()->second.since < deadline) {
+                    skipTo = state.pending.begin()->first - 1;
+                }
+                if (!state.held.empty() && state.held.front().since < deadline) {
+                    skipTo = std::max(skipTo, state.held.front().seq);
+                }
+                if (skipTo == state.delivered) continue;
+                LOG_WARN("Broadcasts ", state.delivered + 1, "..", skipTo, " from node ", entry.first,
+                         " were lost, skipping them");
+
+                // Broadcast dang doi co so nho hon diem bo qua van duoc giao theo thu tu
+                while (!state.pending.empty() && state.pending.begin()->first <= skipTo) {
+                    state.delivered = state.pending.begin()->first - 1;
+                    drain(state, ready);
+                }
+                state.delivered = std::max(state.delivered, skipTo);
+                drain(state, ready);
+            }
+        }
+
+        for (auto& payload : ready) {
+            deliver(std::move(payload));
+        }
+    }
+
+private:
+    int nodeAt(int origin, long rank) const {
+        return (origin - 1 + rank) % totalNodes + 1;
+    }
+
+    // Cac ham duoi day goi khi dang giu mutex
+
+    void forward(int origin, const std::string& envelope, const Relay& relay, const Suspected& suspected) {
+        std::vector<int> next;
+        children(origin, rankOf(origin, id), suspected, next);
+        if (next.empty()) return;
+
+        if (resendWindow.count() > 0) {
+            prune();
+            recent.push_back({origin, messagePool().acquire(envelope.data(), envelope.size()), Clock::now()});
+        }
+        relay(next, envelope);
+    }
+
+    void prune() {
+        auto deadline = Clock::now() - resendWindow;
+        while (!recent.empty() && recent.front().at < deadline) {
+            messagePool().release(std::move(recent.front().envelope));
+            recent.pop_front();
+        }
+    }
+
+    // Giao cac broadcast lien tiep roi cac tin nhan gui thang da du dieu kien, theo dung thu tu nhan
+    static void drain(Origin& state, std::vector<std::string>& ready) {
+        auto it = state.pending.begin();
+        while (it != state.pending.end() && it->first == state.delivered + 1) {
+            it->second.message.erase(0, it->second.headerSize);
+            ready.push_back(std::move(it->second.message));
+            state.delivered = it->first;
+            it = state.pending.erase(it);
+        }
+
+        while (!state.held.empty() && state.held.front().seq <= state.delivered) {
+            Held& held = state.held.front();
+            held.message.erase(0, held.headerSize);
+            ready.push_back(std::move(held.message));
+            state.held.pop_front();
+        }
+    }
+
+    static void appendNumber(std::string& out, uint64_t value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        out.append(digits, result.ptr - digits);
+    }
+
+    void writeHeader(std::string& out, char kind, uint32_t seq) const {
+        out.clear();
+        out += kind;
+        out += '|';
+        appendNumber(out, id);
+        out += '|';
+        appendNumber(out, epoch);
+        out += '|';
+        appendNumber(out, seq);
+        out += '|';
+    }
+
+    static bool parseHeader(const std::string& message, int& origin, uint32_t& epoch, uint32_t& seq, size_t& headerSize) {
+        const char* text = message.c_str();
+        char* end;
+        origin = std::strtol(text + 2, &end, 10);
+        if (*end != '|') return false;
+        epoch = std::strtoul(end + 1, &end, 10);
+        if (*end != '|') return false;
+        seq = std::strtoul(end + 1, &end, 10);
+        if (*end != '|') return false;
+        headerSize = end + 1 - text;
+        return origin > 0;
+    }
+};
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "log.h"
+#include <string>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+extern Logger logger;
+
+// Vong doi cua mot tien trinh nut. Luong chinh chi cho su kien (tin hieu, dong lenh tu stdin, yeu cau dung)
+// nen nut nhan roi khong ton CPU. SIGINT/SIGTERM bi chan o moi luong va doc qua signalfd, vi vay Runtime
+// phai duoc tao truoc moi luong khac (logger, Comm, ...) de cac luong do thua huong mat na tin hieu.
+// Khi dung: chay cac buoc onShutdown theo thu tu dang ky (nha khoa, dung Comm, ...), cho cac luong
+// nen ket thuc roi ghi het log.
+class Runtime {
+private:
+    int signalFd = -1;
+    int stopFd = -1;                                    // Doc duoc mai mai sau khi co yeu cau dung
+    std::vector<std::thread> workers;
+    std::vector<std::function<void()>> shutdownSteps;
+
+    std::function<void(const std::string&)> lineHandler;
+    std::thread inputThread;                            // Xu ly dong lenh, co the cho lau (vd cho vung gang)
+    std::mutex inputMutex;
+    std::condition_variable inputReady;
+    std::deque<std::string> lines;
+    bool stopping = false;
+    bool stopped = false;
+
+public:
+    Runtime() {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGINT);
+        sigaddset(&mask, SIGTERM);
+        if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+            throw std::runtime_error("Failed to block signals");
+        }
+        signalFd = signalfd(-1, &mask, SFD_CLOEXEC);
+        stopFd = eventfd(0, EFD_CLOEXEC);
+        if (signalFd < 0 || stopFd < 0) {
+            throw std::runtime_error("Failed to create runtime descriptors");
+        }
+    }
+
+    ~Runtime() {
+        stop();
+        close(signalFd);
+        close(stopFd);
+    }
+
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+
+    // Chay mot luong nen; ham phai tu ket thuc sau cac buoc onShutdown (vd Comm::stop)
+    void spawn(std::function<void()> work) {
+        workers.emplace_back(std::move(work));
+    }
+
+    void onShutdown(std::function<void()> step) {
+        shutdownSteps.push_back(std::move(step));
+    }
+
+    // Moi dong doc tu stdin duoc xu ly lan luot tren mot luong rieng. stdin dong chi dung viec doc lenh,
+    // nut van chay cho toi khi co tin hieu dung
+    void onLine(std::function<void(const std::string&)> handler) {
+        lineHandler = std::move(handler);
+        inputThread = std::thread(&Runtime::processLines, this);
+    }
+
+    // Cac vong lap su kien khac theo doi fd nay de dung cung luc
+    int stopDescriptor() const {
+        return stopFd;
+    }
+
+    bool isStopping() {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        return stopping;
+    }
+
+    // Goi duoc tu bat ky luong nao
+    void requestStop() {
+        uint64_t one = 1;
+        if (write(stopFd, &one, sizeof(one)) < 0) {}
+    }
+
+    // Cho toi khi co SIGINT/SIGTERM hoac requestStop(), roi dung tien trinh; tra ve ma thoat
+    int run() {
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        watch(epollFd, signalFd);
+        watch(epollFd, stopFd);
+
+        std::string pending;
+        bool readInput = static_cast<bool>(lineHandler);
+        if (readInput && !watch(epollFd, STDIN_FILENO)) {
+            // File thuong khong dung duoc voi epoll nhung doc khong bao gio phai cho
+            readAll(pending);
+            readInput = false;
+        }
+
+        bool running = true;
+        epoll_event events[4];
+        while (running) {
+            int n = epoll_wait(epollFd, events, 4, -1);
+            if (n < 0 && errno != EINTR) {
+                LOG_ERROR("Runtime epoll_wait failed: ", strerror(errno));
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == signalFd) {
+                    signalfd_siginfo info;
+                    if (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+                        LOG_INFO("Received ", strsignal(info.ssi_signo), ", stopping");
+                    }
+                    running = false;
+                }
+                else if (fd == stopFd) {
+                    running = false;
+                }
+                else if (fd == STDIN_FILENO && !readChunk(pending)) {
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+                    LOG_DEBUG("stdin closed, no more commands");
+                }
+            }
+        }
+
+        close(epollFd);
+        stop();
+        return 0;
+    }
+
+    // Dung theo thu tu: bao cac luong dang cho, chay cac buoc dung, cho cac luong ket thuc, ghi het log
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            if (stopped) return;
+            stopped = stopping = true;
+            lines.clear();
+        }
+        requestStop();
+        inputReady.notify_all();
+
+        for (auto& step : shutdownSteps) {
+            try {
+                step();
+            } catch (const std::exception& e) {
+                LOG_WARN("Shutdown step failed: ", e.what());
+            }
+        }
+
+        if (inputThread.joinable()) inputThread.join();
+        for (auto& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+        workers.clear();
+        logger.flush();
+    }
+
+private:
+    static bool watch(int epollFd, int fd) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    // Mot lan read: epoll bao san sang nen khong bi chan. false khi het stdin
+    bool readChunk(std::string& pending) {
+        char buffer[4096];
+        ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) return true;
+            if (!pending.empty()) queueLine(std::move(pending));
+            pending.clear();
+            return false;
+        }
+
+        pending.append(buffer, n);
+        size_t start = 0, end;
+        while ((end = pending.find('\n', start)) != std::string::npos) {
+            queueLine(pending.substr(start, end - start));
+            start = end + 1;
+        }
+        pending.erase(0, start);
+        return true;
+    }
+
+    void readAll(std::string& pending) {
+        while (readChunk(pending)) {}
+    }
+
+    void queueLine(std::string line) {
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            if (stopping) return;
+            lines.push_back(std::move(line));
+        }
+        inputReady.notify_one();
+    }
+
+    void processLines() {
+        std::unique_lock<std::mutex> lock(inputMutex);
+        while (true) {
+            inputReady.wait(lock, [this] { return stopping || !lines.empty(); });
+            if (stopping) break;
+            std::string line = std::move(lines.front());
+            lines.pop_front();
+
+            lock.unlock();
+            lineHandler(line);
+            lock.lock();
+        }
+    }
+};
+
+#endif
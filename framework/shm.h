@@ -0,0 +1,363 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "transport.h"
+#include "config.h"
+#include "pool.h"
+#include "log.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ifaddrs.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+extern Config config;
+extern Logger logger;
+
+// Vong dem SPSC nam trong /dev/shm, moi cap (nut gui -> nut nhan) co mot vong rieng.
+// Vi tri head/tail tang don dieu, offset = vi tri % capacity.
+struct ShmRing {
+    alignas(64) std::atomic<uint64_t> head;  // Vi tri doc (nut nhan ghi)
+    alignas(64) std::atomic<uint64_t> tail;  // Vi tri ghi (nut gui ghi)
+    alignas(64) char data[1];
+};
+
+// Chuong bao cua nut nhan, dung chung cho moi vong di vao nut do (futex lien tien trinh).
+// senders: bit cua moi nut da tao vong toi nut nay (theo id); joined tang moi khi co bit moi
+// de nut nhan biet phai map them vong. Nut chet dot ngot thi segment con nguyen cho lan khoi dong lai.
+// Nut dung binh thuong bat closed roi shm_unlink chuong va cac vong di vao: nut gui thay closed thi
+// bo mapping cu, va chi map lai khi nut nhan da tao chuong moi (nut gui khong bao gio tao chuong). Segment cua nut bi bo khoi cum (hoac doi cong) khong ai xoa:
+// dung ca cum roi xoa /dev/shm/lamport_bell_* va /dev/shm/lamport_ring_*.
+struct ShmBell {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> sleeping;
+    std::atomic<uint32_t> joined;
+    std::atomic<uint32_t> closed;           // Nam trong phan dem cu truoc senders: segment cu doc ra 0
+    std::atomic<uint64_t> senders[1];
+};
+
+class ShmTransport : public Transport {
+private:
+    static constexpr uint64_t RING_CAPACITY = 1 << 20;
+    static constexpr uint32_t WRAP_MARKER = UINT32_MAX;
+
+    struct Segment {
+        std::string name;
+        void* addr = MAP_FAILED;
+        size_t size = 0;
+    };
+
+    struct Outbound {
+        Segment ringSegment, bellSegment;
+        ShmRing* ring;
+        ShmBell* bell;
+        std::mutex mutex;   // Nhieu luong trong tien trinh co the cung gui toi mot nut
+
+        ~Outbound() {
+            unmap(ringSegment);
+            unmap(bellSegment);
+        }
+    };
+
+    int id;
+    int port;
+    std::set<int> peers;
+    Deliver deliver;
+    Segment bellSegment;
+    ShmBell* bell;
+    std::map<int, Segment> inboundSegments;     // Chi luong nhan sua sau khi khoi tao
+    uint32_t seenJoined = 0;
+    std::mutex outboundMutex;                   // Bao ve outbound; vong toi moi nut chi map khi gui lan dau
+    std::map<int, std::shared_ptr<Outbound>> outbound;   // Luong dang gui giu ban sao khi nut nhan dong chuong
+    std::atomic<bool> running{true};
+    std::thread receiveThread;
+
+public:
+    ShmTransport(int id, const std::set<int>& peers, Deliver deliver)
+        : id(id), port(config.getNodePort(id)), peers(peers), deliver(deliver) {
+        bellSegment = map(bellName(port), bellSize());
+        bell = static_cast<ShmBell*>(bellSegment.addr);
+
+        // Vong di vao tu cac nut da tung gui toi nut nay: bo qua du lieu con sot lai tu lan chay truoc
+        seenJoined = bell->joined.load();
+        mapSenders(true);
+
+        receiveThread = std::thread(&ShmTransport::receive, this);
+    }
+
+    ~ShmTransport() {
+        running = false;
+        bell->seq.fetch_add(1);
+        futex(&bell->seq, FUTEX_WAKE, INT_MAX);
+        if (receiveThread.joinable()) {
+            receiveThread.join();
+        }
+
+        outbound.clear();
+
+        // Dung binh thuong: bao nut gui truoc roi moi xoa, de chung map lai segment moi thay vi ghi vao
+        // segment mo coi. Vong cua nut gui chua kip map cung duoc xoa theo bit trong chuong
+        bell->closed.store(1);
+        for (int peer : peers) {
+            if (bell->senders[peer / 64].load() & (uint64_t(1) << (peer % 64))) {
+                shm_unlink(ringName(config.getNodePort(peer), port).c_str());
+            }
+        }
+        shm_unlink(bellSegment.name.c_str());
+        for (auto& entry : inboundSegments) {
+            unmap(entry.second);
+        }
+        unmap(bellSegment);
+    }
+
+    // Nut co dia chi tren chinh may nay (loopback hoac mot giao dien mang cuc bo)
+    static bool isLocalAddress(in_addr addr) {
+        if ((ntohl(addr.s_addr) >> 24) == 127) return true;
+
+        // Danh sach giao dien chi doc mot lan, cum lon goi ham nay cho tung nut luc khoi dong
+        static const std::set<uint32_t> interfaces = [] {
+            std::set<uint32_t> result;
+            struct ifaddrs* list;
+            if (getifaddrs(&list) < 0) return result;
+            for (struct ifaddrs* it = list; it; it = it->ifa_next) {
+                if (it->ifa_addr && it->ifa_addr->sa_family == AF_INET) {
+                    result.insert(((struct sockaddr_in*)it->ifa_addr)->sin_addr.s_addr);
+                }
+            }
+            freeifaddrs(list);
+            return result;
+        }();
+        return interfaces.count(addr.s_addr) > 0;
+    }
+
+    static bool isLocalAddress(const std::string& ip) {
+        in_addr addr;
+        return inet_pton(AF_INET, ip.c_str(), &addr) == 1 && isLocalAddress(addr);
+    }
+
+    void send(int destId, const std::string &message) override {
+        enqueue(destId, message, true);
+    }
+
+    // Vong day (nut nhan da chet) thi bo qua ngay, khong doi
+    void sendBestEffort(int destId, const std::string &message) override {
+        enqueue(destId, message, false);
+    }
+
+private:
+    void enqueue(int destId, const std::string &message, bool wait) {
+        std::shared_ptr<Outbound> connection = connect(destId);
+        if (connection->bell->closed.load()) {
+            connection = connect(destId, connection);
+        }
+        Outbound& out = *connection;
+        uint64_t need = align(sizeof(uint32_t) + message.size());
+        if (need > RING_CAPACITY / 2) {
+            throw std::runtime_error("Message too large for shared memory ring");
+        }
+
+        std::lock_guard<std::mutex> lock(out.mutex);
+        ShmRing* ring = out.ring;
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t offset = tail % RING_CAPACITY;
+        uint64_t contiguous = RING_CAPACITY - offset;
+        uint64_t total = (need <= contiguous) ? need : contiguous + need;
+
+        // Vong day: doi nut nhan doc bot, nut nhan da chet thi bao loi nhu TCP
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (RING_CAPACITY - (tail - ring->head.load(std::memory_order_acquire)) < total) {
+            if (!wait) return;
+            if (std::chrono::steady_clock::now() > deadline) {
+                throw std::runtime_error("Shared memory ring to node " + std::to_string(destId) + " is full");
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+
+        if (need > contiguous) {
+            writeLength(ring, offset, WRAP_MARKER);
+            tail += contiguous;
+            offset = 0;
+        }
+        writeLength(ring, offset, message.size());
+        memcpy(ring->data + offset + sizeof(uint32_t), message.data(), message.size());
+        ring->tail.store(tail + need, std::memory_order_release);
+
+        // Chi goi futex khi nut nhan dang ngu
+        out.bell->seq.fetch_add(1);
+        if (out.bell->sleeping.load()) {
+            futex(&out.bell->seq, FUTEX_WAKE, 1);
+        }
+    }
+
+    // Vong toi destId, map lan dau gui: tao vong truoc roi moi bat bit trong chuong cua nut nhan.
+    // stale: mapping ma nut nhan da dong (closed), duoc thay bang segment moi
+    std::shared_ptr<Outbound> connect(int destId, const std::shared_ptr<Outbound>& stale = nullptr) {
+        std::lock_guard<std::mutex> lock(outboundMutex);
+        auto it = outbound.find(destId);
+        if (it != outbound.end() && it->second != stale) return it->second;
+        if (!peers.count(destId)) {
+            throw std::runtime_error("No shared memory ring to node " + std::to_string(destId));
+        }
+
+        int peerPort = config.getNodePort(destId);
+        auto out = std::make_shared<Outbound>();
+        // Chuong chua co (nut nhan chua chay hoac da dung) thi bao loi nhu TCP khi khong ket noi duoc
+        out->bellSegment = map(bellName(peerPort), bellSize(), false);
+        out->ringSegment = map(ringName(port, peerPort), ringSize());
+        out->ring = static_cast<ShmRing*>(out->ringSegment.addr);
+        out->bell = static_cast<ShmBell*>(out->bellSegment.addr);
+
+        uint64_t bit = uint64_t(1) << (id % 64);
+        if (!(out->bell->senders[id / 64].fetch_or(bit) & bit)) {
+            out->bell->joined.fetch_add(1);
+        }
+        return outbound[destId] = std::move(out);
+    }
+
+    // Map vong cua cac nut gui moi co bit trong chuong; skip = true chi luc khoi dong
+    void mapSenders(bool skip) {
+        for (int peer : peers) {
+            if (inboundSegments.count(peer) || !(bell->senders[peer / 64].load() & (uint64_t(1) << (peer % 64)))) continue;
+            Segment in = map(ringName(config.getNodePort(peer), port), ringSize());
+            if (skip) {
+                ShmRing* ring = static_cast<ShmRing*>(in.addr);
+                ring->head.store(ring->tail.load(std::memory_order_acquire), std::memory_order_release);
+            }
+            inboundSegments[peer] = in;
+        }
+    }
+
+    static uint64_t align(uint64_t n) {
+        return (n + 7) & ~uint64_t(7);
+    }
+
+    static size_t ringSize() {
+        return offsetof(ShmRing, data) + RING_CAPACITY;
+    }
+
+    // Mot bit cho moi id nut, id lon nhat la getTotalNodes()
+    static size_t bellSize() {
+        return offsetof(ShmBell, senders) + (config.getTotalNodes() / 64 + 1) * sizeof(uint64_t);
+    }
+
+    static std::string bellName(int port) {
+        return "/lamport_bell_" + std::to_string(port);
+    }
+
+    static std::string ringName(int fromPort, int toPort) {
+        return "/lamport_ring_" + std::to_string(fromPort) + "_" + std::to_string(toPort);
+    }
+
+    static long futex(std::atomic<uint32_t>* addr, int op, uint32_t val) {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, nullptr, nullptr, 0);
+    }
+
+    static void writeLength(ShmRing* ring, uint64_t offset, uint32_t len) {
+        memcpy(ring->data + offset, &len, sizeof(len));
+    }
+
+    static Segment map(const std::string& name, size_t size, bool create = true) {
+        int fd = shm_open(name.c_str(), create ? O_CREAT | O_RDWR : O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open shared memory " + name + ": " + strerror(errno));
+        }
+        struct stat info;
+        if (!create && (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < size)) {
+            close(fd);
+            throw std::runtime_error("Shared memory " + name + " is not ready");
+        }
+        if (create && ftruncate(fd, size) < 0) {
+            close(fd);
+            throw std::runtime_error("Failed to size shared memory " + name);
+        }
+
+        Segment segment;
+        segment.name = name;
+        segment.size = size;
+        segment.addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (segment.addr == MAP_FAILED) {
+            throw std::runtime_error("Failed to map shared memory " + name);
+        }
+        return segment;
+    }
+
+    static void unmap(Segment& segment) {
+        if (segment.addr != MAP_FAILED) munmap(segment.addr, segment.size);
+        segment.addr = MAP_FAILED;
+    }
+
+    // Doc het du lieu san co trong mot vong, tra ve true neu doc duoc it nhat mot tin nhan
+    bool drain(ShmRing* ring) {
+        bool got = false;
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+        while (head != tail) {
+            uint64_t offset = head % RING_CAPACITY;
+            uint32_t len;
+            memcpy(&len, ring->data + offset, sizeof(len));
+            if (len == WRAP_MARKER) {
+                head += RING_CAPACITY - offset;
+                continue;
+            }
+            deliver(messagePool().acquire(ring->data + offset + sizeof(uint32_t), len));
+            head += align(sizeof(uint32_t) + len);
+            got = true;
+        }
+
+        ring->head.store(head, std::memory_order_release);
+        return got;
+    }
+
+    bool pending() {
+        if (bell->joined.load() != seenJoined) return true;
+        for (auto& entry : inboundSegments) {
+            ShmRing* ring = static_cast<ShmRing*>(entry.second.addr);
+            if (ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_acquire)) return true;
+        }
+        return false;
+    }
+
+    void receive() {
+        while (running) {
+            uint32_t joined = bell->joined.load();
+            if (joined != seenJoined) {
+                seenJoined = joined;
+                mapSenders(false);
+            }
+
+            bool got = false;
+            for (auto& entry : inboundSegments) {
+                got |= drain(static_cast<ShmRing*>(entry.second.addr));
+            }
+            if (got) continue;
+
+            // Lay seq truoc khi kiem tra lai: tin nhan den sau do se lam futex_wait tra ve ngay
+            uint32_t seq = bell->seq.load();
+            bell->sleeping.store(1);
+            if (!pending() && running) {
+                futex(&bell->seq, FUTEX_WAIT, seq);
+            }
+            bell->sleeping.store(0);
+        }
+    }
+};
+
+#endif
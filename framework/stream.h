@@ -0,0 +1,520 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "transport.h"
+#include "uring.h"
+#include "pool.h"
+#include "log.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include <exception>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+extern Logger logger;
+
+// Truyen tin qua ket noi stream giu lau dai (moi cap nut mot ket noi), moi tin nhan co
+// tien to do dai 4 byte. Lop con chi can cung cap dia chi cua tung nut.
+// Neu bat io_uring: gui nhieu nut trong mot lan io_uring_enter, nhan bang multishot recv
+// vao cac vung dem da dang ky; khong co io_uring thi dung poll/send thong thuong.
+class StreamTransport : public Transport {
+protected:
+    int listenSocket = -1;
+    int wakeFd = -1;
+    Deliver deliver;
+    std::atomic<bool> running{true};
+    std::thread receiveThread;
+    std::mutex connectionsMutex;
+    std::map<int, int> connections;   // id nut dich -> socket da ket noi
+
+    // io_uring cho luong gui (bao ve boi connectionsMutex)
+    bool uring;
+    std::unique_ptr<IoUring> sendRing;
+    std::vector<char> sendBuffer;     // Vung dem da dang ky voi kernel
+    bool sendFixed = false;
+    std::string frame;                // Vung dem gui dung lai (bao ve boi connectionsMutex)
+    std::vector<int> retry;
+
+    static constexpr unsigned SEND_ENTRIES = 256;
+    static constexpr unsigned RECV_BUFFERS = 64;
+    static constexpr unsigned RECV_BUFFER_SIZE = 4096;
+    static constexpr unsigned short BUFFER_GROUP = 0;
+    enum : uint64_t { OP_WAKE = 1, OP_ACCEPT = 2, OP_RECV = 3, OP_PROVIDE = 4 };
+
+    virtual int domain() const = 0;
+    virtual socklen_t address(int nodeId, sockaddr_storage& addr) const = 0;
+    virtual void configure(int fd) const { (void)fd; }
+
+    StreamTransport(Deliver deliver, bool uring) : deliver(deliver), uring(uring) {}
+
+    // Lop con goi sau khi da san sang (ham ao chua dung duoc trong constructor cua lop co so)
+    void listen(int ownId) {
+        if ((listenSocket = socket(domain(), SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+            throw std::runtime_error("Creating socket failed");
+        }
+
+        int opt = 1;
+        setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        sockaddr_storage addr;
+        socklen_t len = address(ownId, addr);
+        if (bind(listenSocket, (struct sockaddr*)&addr, len) < 0) {
+            close(listenSocket);
+            throw std::runtime_error("Bind failed");
+        }
+
+        if (::listen(listenSocket, SOMAXCONN) < 0) {
+            close(listenSocket);
+            throw std::runtime_error("Listen failed");
+        }
+
+        if (uring) {
+            try {
+                sendRing = std::make_unique<IoUring>(SEND_ENTRIES);
+                sendBuffer.resize(64 * 1024);
+                iovec iov = {sendBuffer.data(), sendBuffer.size()};
+                sendFixed = sendRing->registerBuffers(&iov, 1) && probeFixedSend();
+            } catch (const std::exception& e) {
+                LOG_WARN("io_uring unavailable, using plain sockets: ", e.what());
+                sendRing.reset();
+            }
+        }
+
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        receiveThread = std::thread(&StreamTransport::receive, this);
+    }
+
+    void shutdown() {
+        running = false;
+        if (wakeFd >= 0) {
+            uint64_t one = 1;
+            if (write(wakeFd, &one, sizeof(one)) < 0) {}
+        }
+        if (receiveThread.joinable()) {
+            receiveThread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (auto& entry : connections) {
+            close(entry.second);
+        }
+        connections.clear();
+        sendRing.reset();
+        if (listenSocket >= 0) close(listenSocket);
+        if (wakeFd >= 0) close(wakeFd);
+        listenSocket = wakeFd = -1;
+    }
+
+public:
+    void send(int destId, const std::string &message) override {
+        sendTo(&destId, 1, message);
+    }
+
+    void sendMany(const std::vector<int>& destIds, const std::string &message) override {
+        sendTo(destIds.data(), destIds.size(), message);
+    }
+
+private:
+    void sendTo(const int* destIds, size_t count, const std::string &message) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        makeFrame(message);
+        dropClosed(destIds, count);
+
+        retry.clear();
+        if (sendRing && frame.size() <= sendBuffer.size()) {
+            sendBatch(destIds, count);
+        }
+        else {
+            retry.assign(destIds, destIds + count);
+        }
+
+        std::exception_ptr error;
+        for (int destId : retry) {
+            try {
+                sendPlain(destId, frame);
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    void makeFrame(const std::string& message) {
+        uint32_t len = message.size();
+        frame.assign(reinterpret_cast<const char*>(&len), sizeof(len));
+        frame += message;
+    }
+
+    int connection(int destId) {
+        auto it = connections.find(destId);
+        if (it != connections.end()) return it->second;
+
+        int fd = socket(domain(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create client socket");
+        }
+
+        sockaddr_storage addr;
+        socklen_t len = address(destId, addr);
+        if (connect(fd, (struct sockaddr*)&addr, len) < 0) {
+            close(fd);
+            throw std::runtime_error("Failed to connect to destination");
+        }
+
+        configure(fd);
+        connections[destId] = fd;
+        return fd;
+    }
+
+    // Ket noi gui khong bao gio nhan du lieu: doc duoc nghia la nut dich da dong (vd khoi dong lai).
+    // Lan ghi dau vao ket noi cu van thanh cong vao vung dem cua socket va tin nhan mat khong bao loi,
+    // nen kiem tra truoc khi gui (mot lan poll cho ca nhom) roi ket noi lai
+    void dropClosed(const int* destIds, size_t count) {
+        static thread_local std::vector<pollfd> fds;
+        static thread_local std::vector<int> ids;
+        fds.clear();
+        ids.clear();
+        for (size_t i = 0; i < count; i++) {
+            auto it = connections.find(destIds[i]);
+            if (it == connections.end()) continue;
+            fds.push_back({it->second, POLLIN | POLLRDHUP, 0});
+            ids.push_back(destIds[i]);
+        }
+        if (fds.empty() || poll(fds.data(), fds.size(), 0) <= 0) return;
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (!fds[i].revents) continue;
+            close(fds[i].fd);
+            connections.erase(ids[i]);
+        }
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    void sendPlain(int destId, const std::string& frame) {
+        // Ket noi cu co the da dut (nut dich khoi dong lai): ket noi lai mot lan
+        for (int attempt = 0; attempt < 2; attempt++) {
+            int fd = connection(destId);
+            if (writeAll(fd, frame.data(), frame.size())) {
+                return;
+            }
+            close(fd);
+            connections.erase(destId);
+        }
+        throw std::runtime_error("Failed to send message");
+    }
+
+    // Kernel cu khong ho tro vung dem dang ky cho IORING_OP_SEND: thu mot lan tren socketpair
+    bool probeFixedSend() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return false;
+
+        io_uring_sqe* sqe = sendRing->getSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = sv[0];
+        sqe->addr = (uint64_t)sendBuffer.data();
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+        sqe->buf_index = 0;
+
+        int res = -1;
+        if (sendRing->submitAndWait(1) == 1) {
+            sendRing->forEachCqe([&](const io_uring_cqe& cqe) { res = cqe.res; });
+        }
+        close(sv[0]);
+        close(sv[1]);
+        return res == 1;
+    }
+
+    // Mot SQE cho moi nut dich, ca nhom chi mot io_uring_enter. Cac nut can gui lai theo cach thuong duoc them vao retry.
+    void sendBatch(const int* destIds, size_t count) {
+        memcpy(sendBuffer.data(), frame.data(), frame.size());
+
+        for (size_t start = 0; start < count; start += SEND_ENTRIES) {
+            size_t end = std::min(count, start + SEND_ENTRIES);
+            int fds[SEND_ENTRIES];
+            bool completed[SEND_ENTRIES] = {};
+            size_t order[SEND_ENTRIES];                 // Chi so nut dich theo thu tu SQE
+            std::fill(fds, fds + (end - start), -1);
+            unsigned queued = 0;
+
+            for (size_t i = start; i < end; i++) {
+                try {
+                    fds[i - start] = connection(destIds[i]);
+                } catch (const std::exception&) {
+                    retry.push_back(destIds[i]);
+                    continue;
+                }
+
+                io_uring_sqe* sqe = sendRing->getSqe();
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = fds[i - start];
+                sqe->addr = (uint64_t)sendBuffer.data();
+                sqe->len = frame.size();
+                sqe->msg_flags = MSG_NOSIGNAL;
+                if (sendFixed) {
+                    sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+                    sqe->buf_index = 0;
+                }
+                sqe->user_data = i;
+                order[queued++] = i;
+            }
+
+            auto handle = [&](const io_uring_cqe& cqe) {
+                size_t i = cqe.user_data;
+                int fd = fds[i - start];
+                completed[i - start] = true;
+                if (cqe.res == (int)frame.size()) return;
+
+                if (cqe.res > 0 && writeAll(fd, frame.data() + cqe.res, frame.size() - cqe.res)) {
+                    // Gui thieu, da gui not phan con lai
+                }
+                else {
+                    close(fd);
+                    connections.erase(destIds[i]);
+                    retry.push_back(destIds[i]);
+                }
+            };
+
+            unsigned done = 0;
+            while (done < queued) {
+                if (sendRing->submitAndWait(queued - done) < 0) {
+                    LOG_WARN("io_uring send failed, using plain sockets: ", strerror(errno));
+                    abandonBatch(destIds, start, end, count, fds, completed, order, queued, handle);
+                    return;
+                }
+                done += sendRing->forEachCqe(handle);
+            }
+        }
+    }
+
+    // submitAndWait loi: bo io_uring, sau do luon gui theo cach thuong. SQE kernel da nhan co the da gui xong
+    // ma chua co CQE, gui lai tren cung ket noi se thanh ban trung (Lamport can moi tin nhan dung mot lan),
+    // nen cho cac CQE do truoc. Chi SQE kernel chua nhan duoc gui lai nhu cu; SQE van khong ro ket qua thi
+    // dong ket noi va gui lai tren ket noi moi
+    template <typename Handle>
+    void abandonBatch(const int* destIds, size_t start, size_t end, size_t count, int* fds, bool* completed,
+                      const size_t* order, unsigned queued, Handle& handle) {
+        unsigned submitted = queued - std::min(queued, sendRing->unsubmitted());
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (true) {
+            sendRing->forEachCqe(handle);
+            bool waiting = false;
+            for (unsigned k = 0; k < submitted; k++) {
+                if (!completed[order[k] - start]) waiting = true;
+            }
+            if (!waiting || std::chrono::steady_clock::now() > deadline) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        sendRing.reset();
+
+        for (unsigned k = 0; k < queued; k++) {
+            size_t i = order[k];
+            if (completed[i - start]) continue;
+            if (k < submitted) {
+                LOG_WARN("io_uring send to node ", destIds[i], " has no result, reconnecting");
+                close(fds[i - start]);
+                connections.erase(destIds[i]);
+            }
+            retry.push_back(destIds[i]);
+        }
+        for (size_t i = end; i < count; i++) {
+            retry.push_back(destIds[i]);
+        }
+    }
+
+    // Tach cac tin nhan hoan chinh khoi bo dem cua mot ket noi
+    void extract(std::string& buffer) {
+        size_t pos = 0;
+        while (buffer.size() - pos >= sizeof(uint32_t)) {
+            uint32_t len;
+            memcpy(&len, buffer.data() + pos, sizeof(len));
+            if (buffer.size() - pos - sizeof(len) < len) break;
+            deliver(messagePool().acquire(buffer.data() + pos + sizeof(len), len));
+            pos += sizeof(len) + len;
+        }
+        buffer.erase(0, pos);
+    }
+
+    void receive() {
+        std::set<int> accepted;
+        std::map<int, std::string> buffers;
+
+        if (!uring || !receiveUring(accepted, buffers)) {
+            receivePoll(accepted, buffers);
+        }
+
+        for (int fd : accepted) {
+            close(fd);
+        }
+    }
+
+    void receivePoll(std::set<int>& accepted, std::map<int, std::string>& buffers) {
+        std::vector<pollfd> fds = {{wakeFd, POLLIN, 0}, {listenSocket, POLLIN, 0}};
+        for (int fd : accepted) {
+            fds.push_back({fd, POLLIN, 0});
+        }
+        char chunk[4096];
+
+        while (running) {
+            if (poll(fds.data(), fds.size(), -1) < 0) continue;
+
+            if (fds[1].revents & POLLIN) {
+                int clientSocket = accept4(listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+                if (clientSocket >= 0) {
+                    fds.push_back({clientSocket, POLLIN, 0});
+                    accepted.insert(clientSocket);
+                }
+            }
+
+            for (size_t i = 2; i < fds.size(); i++) {
+                if (!fds[i].revents) continue;
+                ssize_t n = recv(fds[i].fd, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    close(fds[i].fd);
+                    accepted.erase(fds[i].fd);
+                    buffers.erase(fds[i].fd);
+                    fds.erase(fds.begin() + i--);
+                    continue;
+                }
+                std::string& buffer = buffers[fds[i].fd];
+                buffer.append(chunk, n);
+                extract(buffer);
+            }
+        }
+    }
+
+    // Tra ve false neu kernel khong ho tro (luong nhan chuyen sang poll, giu lai cac ket noi da nhan)
+    bool receiveUring(std::set<int>& accepted, std::map<int, std::string>& buffers) {
+        std::vector<char> pool(RECV_BUFFERS * RECV_BUFFER_SIZE);
+        std::unique_ptr<IoUring> ring;
+        try {
+            ring = std::make_unique<IoUring>(256);
+        } catch (const std::exception&) {
+            return false;
+        }
+
+        auto tag = [](uint64_t op, int fd) { return (op << 32) | (uint32_t)fd; };
+        auto sqeFor = [&] {
+            io_uring_sqe* sqe = ring->getSqe();
+            if (!sqe) {
+                ring->submitAndWait(0);
+                sqe = ring->getSqe();
+            }
+            return sqe;
+        };
+        auto armWake = [&] {
+            io_uring_sqe* sqe = ring->getSqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = wakeFd;
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = tag(OP_WAKE, wakeFd);
+        };
+        auto armAccept = [&] {
+            io_uring_sqe* sqe = ring->getSqe();
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = listenSocket;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_CLOEXEC;
+            sqe->user_data = tag(OP_ACCEPT, listenSocket);
+        };
+        auto armRecv = [&](int fd) {
+            io_uring_sqe* sqe = sqeFor();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BUFFER_GROUP;
+            sqe->user_data = tag(OP_RECV, fd);
+        };
+
+        // Cac vung dem nhan thuoc ve kernel, duoc tra lai sau khi doc xong
+        ring->provideBuffers(pool.data(), RECV_BUFFER_SIZE, RECV_BUFFERS, BUFFER_GROUP, 0, tag(OP_PROVIDE, 0));
+        armWake();
+        armAccept();
+        bool unsupported = false;
+
+        while (running && !unsupported) {
+            // Mot lan goi: nop cac yeu cau moi va doi; sau do xu ly ca loat CQE khong can syscall
+            if (ring->submitAndWait(1) < 0) {
+                unsupported = true;
+                break;
+            }
+
+            ring->forEachCqe([&](const io_uring_cqe& cqe) {
+                uint64_t op = cqe.user_data >> 32;
+                int fd = (int)(uint32_t)cqe.user_data;
+                bool more = cqe.flags & IORING_CQE_F_MORE;
+
+                if (op == OP_PROVIDE) {
+                    if (cqe.res < 0) unsupported = true;
+                }
+                else if (op == OP_ACCEPT) {
+                    if (cqe.res >= 0) {
+                        accepted.insert(cqe.res);
+                        armRecv(cqe.res);
+                    }
+                    else if (cqe.res == -EINVAL) {
+                        unsupported = true;
+                    }
+                    if (!more && !unsupported) armAccept();
+                }
+                else if (op == OP_RECV) {
+                    if (cqe.res > 0) {
+                        unsigned short bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                        char* data = pool.data() + (size_t)bid * RECV_BUFFER_SIZE;
+                        std::string& buffer = buffers[fd];
+                        buffer.append(data, cqe.res);
+                        extract(buffer);
+                        if (!ring->provideBuffers(data, RECV_BUFFER_SIZE, 1, BUFFER_GROUP, bid, tag(OP_PROVIDE, fd))) {
+                            ring->submitAndWait(0);
+                            ring->provideBuffers(data, RECV_BUFFER_SIZE, 1, BUFFER_GROUP, bid, tag(OP_PROVIDE, fd));
+                        }
+                        if (!more) armRecv(fd);
+                    }
+                    else if (cqe.res == -ENOBUFS) {
+                        armRecv(fd);
+                    }
+                    else if (cqe.res == -EINVAL) {
+                        unsupported = true;
+                    }
+                    else if (!more) {
+                        close(fd);
+                        accepted.erase(fd);
+                        buffers.erase(fd);
+                    }
+                }
+            });
+        }
+
+        if (unsupported) {
+            LOG_WARN("io_uring multishot receive unavailable, using poll");
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TCP_H
+#define TCP_H
+
+#include "stream.h"
+#include "config.h"
+#include <string>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+extern Config config;
+
+// Ket noi TCP giu lau dai giua cac nut (tat Nagle vi tin nhan deu rat nho)
+class TcpTransport : public StreamTransport {
+private:
+    int id;
+    int port;
+
+public:
+    TcpTransport(int id, int port, Deliver deliver) : StreamTransport(deliver, config.useIoUring()), id(id), port(port) {
+        listen(id);
+    }
+
+    ~TcpTransport() {
+        shutdown();
+    }
+
+protected:
+    int domain() const override {
+        return AF_INET;
+    }
+
+    socklen_t address(int nodeId, sockaddr_storage& storage) const override {
+        sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(&storage);
+        memset(addr, 0, sizeof(sockaddr_in));
+        addr->sin_family = AF_INET;
+        if (nodeId == id) {
+            addr->sin_port = htons(port);
+            addr->sin_addr.s_addr = INADDR_ANY;
+        }
+        else {
+            addr->sin_port = htons(config.getNodePort(nodeId));
+            addr->sin_addr = config.getNodeAddress(nodeId);
+        }
+        return sizeof(sockaddr_in);
+    }
+
+    void configure(int fd) const override {
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+};
+
+#endif
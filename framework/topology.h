@@ -0,0 +1,302 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+// Thong tin mot node, kich thuoc co dinh de luu thanh mang lien tuc va ghi thang ra file cache
+struct NodeInfo {
+    int32_t id;
+    uint32_t address;       // IPv4, thu tu byte mang
+    uint16_t port;
+    uint8_t transport;      // chi so trong TRANSPORT_NAMES
+    uint8_t pad;
+    uint16_t group;         // chi so trong Topology::groups
+    uint16_t pad2;
+};
+
+static const char* const TRANSPORT_NAMES[] = {"auto", "tcp", "shm", "unix", "udp"};
+
+inline int parseTransport(const std::string& name) {
+    for (int i = 0; i < 5; i++) {
+        if (name == TRANSPORT_NAMES[i]) return i;
+    }
+    return -1;
+}
+
+// File cau truc cum, moi dong mot khai bao:
+//   # chu thich
+//   group rack1 ip=10.0.1.1+ port=8081 transport=auto     gia tri mac dinh cho nhom
+//   nodes 1-500 group=rack1                                 khoang node, dung mac dinh cua nhom
+//   nodes 501-1000 ip=10.0.2.1+ port=9000+2 transport=udp
+//   node 1001 ip=10.0.3.5 port=8081
+// "a+" tang them 1 cho moi node tiep theo trong dong, "a+k" tang them k.
+// Id node phai lien tuc tu 1; nodes[i] la node co id i + 1.
+class Topology {
+public:
+    std::vector<NodeInfo> nodes;
+    std::vector<std::string> groups = {"default"};
+
+    // Doc tu cache nhi phan neu cache con khop voi file nguon (kich thuoc va thoi gian sua), neu khong thi
+    // phan tich file nguon roi ghi lai cache
+    static Topology load(const std::string& path) {
+        struct stat source;
+        if (stat(path.c_str(), &source) < 0) {
+            throw std::runtime_error("Cannot open topology file " + path);
+        }
+        int64_t mtime = (int64_t)source.st_mtim.tv_sec * 1000000000 + source.st_mtim.tv_nsec;
+
+        Topology topology;
+        std::string cachePath = path + ".cache";
+        if (topology.readCache(cachePath, source.st_size, mtime)) {
+            return topology;
+        }
+
+        topology.parse(path);
+        topology.writeCache(cachePath, source.st_size, mtime);
+        return topology;
+    }
+
+private:
+    static constexpr uint64_t CACHE_MAGIC = 0x314f504f544d504cULL;
+    static constexpr int MAX_NODES = 1 << 20;       // Gioi han id node, tranh cap phat khong lo vi mot dong go nham
+    static constexpr size_t MAX_GROUPS = 65535;     // NodeInfo::group la uint16_t
+
+    struct CacheHeader {
+        uint64_t magic;
+        int64_t sourceSize;
+        int64_t sourceMtime;
+        uint32_t nodeCount;
+        uint32_t namesSize;     // Ten nhom noi tiep nhau, moi ten ket thuc bang '\0'
+    };
+
+    // Gia tri "a" hoac "a+k": gia tri cua node thu i trong dong la base + step * i
+    struct Counter {
+        bool set = false;
+        uint32_t base = 0;
+        uint32_t step = 0;
+    };
+
+    struct Template {
+        Counter ip, port;
+        int transport = 0;
+        uint16_t group = 0;
+    };
+
+    void parse(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Cannot open topology file " + path);
+        }
+
+        std::map<std::string, Template> groupDefaults;
+        std::string line, word;
+        int lineNumber = 0;
+
+        while (std::getline(file, line)) {
+            lineNumber++;
+            std::string where = path + ":" + std::to_string(lineNumber) + ": ";
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) line.resize(comment);
+
+            std::istringstream words(line);
+            if (!(words >> word)) continue;
+
+            if (word == "group") {
+                std::string name;
+                if (!(words >> name)) throw std::runtime_error(where + "group needs a name");
+                if (groupDefaults.count(name)) throw std::runtime_error(where + "group " + name + " defined twice");
+                if (groups.size() >= MAX_GROUPS) throw std::runtime_error(where + "too many groups");
+
+                Template defaults;
+                defaults.group = groups.size();
+                groups.push_back(name);
+                while (words >> word) applyKey(defaults, word, groupDefaults, where, false);
+                groupDefaults[name] = defaults;
+            }
+            else if (word == "nodes" || word == "node") {
+                std::string range;
+                if (!(words >> range)) throw std::runtime_error(where + "missing node range");
+                int first, last;
+                parseRange(range, first, last, where);
+
+                Template node;
+                std::vector<std::string> keys;
+                while (words >> word) keys.push_back(word);
+                // group= truoc de cac khoa khac ghi de len mac dinh cua nhom
+                for (const auto& key : keys) {
+                    if (key.compare(0, 6, "group=") == 0) applyKey(node, key, groupDefaults, where, true);
+                }
+                for (const auto& key : keys) {
+                    if (key.compare(0, 6, "group=") != 0) applyKey(node, key, groupDefaults, where, true);
+                }
+                if (!node.ip.set || !node.port.set) {
+                    throw std::runtime_error(where + "nodes need ip and port (directly or from their group)");
+                }
+                addRange(node, first, last, where);
+            }
+            else {
+                throw std::runtime_error(where + "unknown declaration '" + word + "'");
+            }
+        }
+
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].id == 0) {
+                throw std::runtime_error(path + ": node " + std::to_string(i + 1) + " is not defined");
+            }
+        }
+        if (nodes.empty()) {
+            throw std::runtime_error(path + ": no nodes defined");
+        }
+    }
+
+    static void parseRange(const std::string& range, int& first, int& last, const std::string& where) {
+        char* end;
+        first = last = std::strtol(range.c_str(), &end, 10);
+        if (*end == '-') last = std::strtol(end + 1, &end, 10);
+        if (*end != '\0' || first <= 0 || last < first) {
+            throw std::runtime_error(where + "invalid node range '" + range + "'");
+        }
+        if (last > MAX_NODES) {
+            throw std::runtime_error(where + "node range '" + range + "' exceeds " + std::to_string(MAX_NODES) + " nodes");
+        }
+    }
+
+    static void applyKey(Template& target, const std::string& key, const std::map<std::string, Template>& groupDefaults,
+                         const std::string& where, bool allowGroup) {
+        size_t eq = key.find('=');
+        if (eq == std::string::npos) throw std::runtime_error(where + "expected key=value, got '" + key + "'");
+        std::string name = key.substr(0, eq), value = key.substr(eq + 1);
+
+        if (name == "ip" || name == "port") {
+            Counter counter;
+            counter.set = true;
+            size_t plus = value.find('+');
+            if (plus != std::string::npos) {
+                counter.step = (plus + 1 == value.size()) ? 1 : std::strtoul(value.c_str() + plus + 1, nullptr, 10);
+                value.resize(plus);
+            }
+
+            if (name == "ip") {
+                in_addr addr;
+                if (inet_pton(AF_INET, value.c_str(), &addr) != 1) throw std::runtime_error(where + "invalid ip '" + value + "'");
+                counter.base = ntohl(addr.s_addr);
+                target.ip = counter;
+            }
+            else {
+                char* end;
+                counter.base = std::strtoul(value.c_str(), &end, 10);
+                if (*end != '\0' || counter.base == 0 || counter.base > 65535) throw std::runtime_error(where + "invalid port '" + value + "'");
+                target.port = counter;
+            }
+        }
+        else if (name == "transport") {
+            target.transport = parseTransport(value);
+            if (target.transport < 0) throw std::runtime_error(where + "invalid transport '" + value + "'");
+        }
+        else if (name == "group" && allowGroup) {
+            auto it = groupDefaults.find(value);
+            if (it == groupDefaults.end()) throw std::runtime_error(where + "unknown group '" + value + "'");
+            target = it->second;
+        }
+        else {
+            throw std::runtime_error(where + "unknown key '" + name + "'");
+        }
+    }
+
+    void addRange(const Template& node, int first, int last, const std::string& where) {
+        if ((size_t)last > nodes.size()) {
+            nodes.resize(last, NodeInfo{0, 0, 0, 0, 0, 0, 0});
+        }
+
+        for (int id = first; id <= last; id++) {
+            uint32_t index = id - first;
+            uint32_t port = node.port.base + node.port.step * index;
+            if (port > 65535) throw std::runtime_error(where + "port of node " + std::to_string(id) + " exceeds 65535");
+
+            NodeInfo& info = nodes[id - 1];
+            if (info.id != 0) throw std::runtime_error(where + "node " + std::to_string(id) + " defined twice");
+            info = NodeInfo{id, htonl(node.ip.base + node.ip.step * index), (uint16_t)port,
+                            (uint8_t)node.transport, 0, node.group, 0};
+        }
+    }
+
+    bool readCache(const std::string& cachePath, int64_t sourceSize, int64_t sourceMtime) {
+        int fd = open(cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+
+        struct stat st;
+        std::string data;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(CacheHeader)) {
+            data.resize(st.st_size);
+            if (read(fd, &data[0], data.size()) != (ssize_t)data.size()) data.clear();
+        }
+        close(fd);
+        if (data.empty()) return false;
+
+        CacheHeader header;
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != CACHE_MAGIC || header.sourceSize != sourceSize || header.sourceMtime != sourceMtime ||
+            data.size() != sizeof(header) + header.nodeCount * sizeof(NodeInfo) + header.namesSize) {
+            return false;
+        }
+
+        // Chi nhan cache khi moi truong deu hop le; cache hong thi phan tich lai file nguon
+        std::vector<NodeInfo> cachedNodes(header.nodeCount);
+        memcpy(cachedNodes.data(), data.data() + sizeof(header), header.nodeCount * sizeof(NodeInfo));
+
+        std::vector<std::string> cachedGroups;
+        const char* names = data.data() + sizeof(header) + header.nodeCount * sizeof(NodeInfo);
+        if (header.namesSize == 0 || names[header.namesSize - 1] != '\0') return false;
+        for (const char* p = names; p < names + header.namesSize; p += strlen(p) + 1) {
+            cachedGroups.push_back(p);
+        }
+
+        if (cachedNodes.empty() || cachedNodes.size() > (size_t)MAX_NODES || cachedGroups.size() > MAX_GROUPS) return false;
+        for (size_t i = 0; i < cachedNodes.size(); i++) {
+            const NodeInfo& info = cachedNodes[i];
+            if (info.id != (int32_t)(i + 1) || info.port == 0 || info.transport >= 5 || info.group >= cachedGroups.size()) {
+                return false;
+            }
+        }
+
+        nodes = std::move(cachedNodes);
+        groups = std::move(cachedGroups);
+        return true;
+    }
+
+    // Ghi cache khong thanh cong (vd thu muc chi doc) thi lan sau phan tich lai, khong phai loi
+    void writeCache(const std::string& cachePath, int64_t sourceSize, int64_t sourceMtime) const {
+        std::string names;
+        for (const auto& group : groups) {
+            names += group;
+            names += '\0';
+        }
+        CacheHeader header = {CACHE_MAGIC, sourceSize, sourceMtime, (uint32_t)nodes.size(), (uint32_t)names.size()};
+
+        std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+        data.append(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(NodeInfo));
+        data += names;
+
+        std::string temp = cachePath + "." + std::to_string(getpid());
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return;
+        bool ok = write(fd, data.data(), data.size()) == (ssize_t)data.size();
+        close(fd);
+        if (!ok || rename(temp.c_str(), cachePath.c_str()) < 0) {
+            unlink(temp.c_str());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+#include <functional>
+#include <vector>
+
+// Lop co so cho cac kieu truyen tin (TCP, shared memory, ...) ma Comm su dung
+class Transport {
+public:
+    // Ham Comm cung cap de day tin nhan nhan duoc vao hang doi
+    using Deliver = std::function<void(std::string&&)>;
+
+    virtual ~Transport() {}
+    virtual void send(int destId, const std::string &message) = 0;
+
+    // Gui cung mot tin nhan toi nhieu nut; kieu truyen tin co the gop lai thanh mot lan goi he thong
+    virtual void sendMany(const std::vector<int>& destIds, const std::string &message) {
+        for (int destId : destIds) {
+            send(destId, message);
+        }
+    }
+
+    // Gui khong can dam bao (heartbeat): mat thi thoi, khong gui lai
+    virtual void sendBestEffort(int destId, const std::string &message) {
+        send(destId, message);
+    }
+
+    // Comm bao nut bi nghi ngo da chet / song lai; kieu truyen tin co gui lai thi tam ngung gui lai toi nut do
+    virtual void setSuspected(int nodeId, bool suspected) {
+        (void)nodeId;
+        (void)suspected;
+    }
+};
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include "transport.h"
+#include "config.h"
+#include "pool.h"
+#include "log.h"
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+
+extern Config config;
+extern Logger logger;
+
+// Datagram UDP cho cac tin nhan dieu khien nho. Moi tin nhan co so thu tu theo tung cap nut,
+// nut nhan gui ACK, nut gui gui lai cho den khi nhan ACK. Nut nhan loai bo ban trung va
+// giao tin nhan dung thu tu gui (thuat toan Lamport can kenh FIFO).
+// So thu tu chi co nghia voi mot lan khoi dong cua ca hai ben: DATA mang epoch cua nut nhan ma nut gui
+// biet. Nut nhan gap DATA danh so cho lan chay khac cua no (hoac khi nut gui chua biet epoch) thi tra
+// RESET kem epoch cua minh, khong ACK; nut gui danh so lai cac tin nhan chua duoc ACK tu 1 va gui lai ngay.
+// Moi nut nhan co toi da MAX_UNACKED tin nhan chua ACK: day thi send() cho toi 1 giay roi bao loi nhu vong
+// shared memory day. Nut bi nghi ngo da chet khong duoc gui lai cho toi khi song lai (hoac gui RESET).
+class UdpTransport : public Transport {
+private:
+    enum FrameKind : uint8_t { DATA = 1, ACK = 2, UNRELIABLE = 3, RESET = 4 };
+
+    struct Header {
+        uint8_t kind;
+        uint8_t pad[3];
+        int32_t from;       // Nut gui frame nay
+        uint32_t epoch;     // Lan khoi dong cua nut gui DATA (ACK gui lai nguyen gia tri)
+        uint32_t seq;
+        uint32_t peerEpoch; // Lan khoi dong cua nut nhan DATA (0 = chua biet); ACK/RESET: epoch cua nut gui ACK
+    };
+
+    struct Pending {
+        std::string frame;
+        std::chrono::steady_clock::time_point nextSend;
+        int attempts = 0;
+    };
+
+    struct Peer {                                   // Trang thai gui toi mot nut
+        uint32_t nextSeq = 1;
+        uint32_t receiverEpoch = 0;                 // Epoch cua nut nhan theo RESET gan nhat
+        bool suspected = false;                     // Ngung gui lai, giu unacked cho toi khi song lai
+        std::map<uint32_t, Pending> unacked;
+    };
+
+    struct Source {                                 // Trang thai nhan tu mot nut
+        uint32_t epoch = 0;
+        uint32_t expected = 1;
+        bool synced = false;                        // Da nhan DATA danh so cho lan chay nay cua nut nhan
+        std::map<uint32_t, std::string> early;      // Tin nhan den truoc thu tu
+    };
+
+    static constexpr auto INITIAL_RTO = std::chrono::milliseconds(20);
+    static constexpr auto MAX_RTO = std::chrono::milliseconds(1000);
+    static constexpr size_t MAX_DATAGRAM = 65507;
+    static constexpr size_t MAX_UNACKED = 1024;
+
+    int id;
+    int udpSocket;
+    int wakeFd;
+    uint32_t epoch;
+    Deliver deliver;
+    std::mutex peersMutex;
+    std::condition_variable retransmitNeeded;
+    std::condition_variable windowOpen;             // Co ACK moi: send() dang cho cua so co the gui tiep
+    std::map<int, Peer> peers;
+    std::map<int, Source> sources;                  // Chi luong nhan truy cap
+    std::atomic<bool> running{true};
+    std::thread receiveThread;
+    std::thread retransmitThread;
+
+public:
+    UdpTransport(int id, Deliver deliver) : id(id), deliver(deliver) {
+        if ((udpSocket = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) {
+            throw std::runtime_error("Creating socket failed");
+        }
+
+        sockaddr_in servaddr;
+        memset(&servaddr, 0, sizeof(servaddr));
+        servaddr.sin_family = AF_INET;
+        servaddr.sin_addr.s_addr = INADDR_ANY;
+        servaddr.sin_port = htons(config.getNodePort(id));
+
+        if (bind(udpSocket, (struct sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
+            close(udpSocket);
+            throw std::runtime_error("Bind failed");
+        }
+
+        epoch = static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count()) ^ getpid();
+        if (epoch == 0) epoch = 1;                  // 0 danh cho epoch chua biet
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        receiveThread = std::thread(&UdpTransport::receive, this);
+        retransmitThread = std::thread(&UdpTransport::retransmit, this);
+    }
+
+    ~UdpTransport() {
+        {
+            std::lock_guard<std::mutex> lock(peersMutex);
+            running = false;
+        }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {}
+        retransmitNeeded.notify_all();
+        windowOpen.notify_all();
+        if (receiveThread.joinable()) receiveThread.join();
+        if (retransmitThread.joinable()) retransmitThread.join();
+        close(udpSocket);
+        close(wakeFd);
+    }
+
+    void send(int destId, const std::string &message) override {
+        if (message.size() + sizeof(Header) > MAX_DATAGRAM) {
+            throw std::runtime_error("Message too large for UDP transport");
+        }
+
+        std::unique_lock<std::mutex> lock(peersMutex);
+        Peer& peer = peers[destId];
+        if (peer.unacked.size() >= MAX_UNACKED) {
+            // Nut bi nghi ngo khong ACK nua: bao loi ngay thay vi cho
+            if (!peer.suspected) {
+                windowOpen.wait_for(lock, std::chrono::seconds(1),
+                                    [&] { return peer.unacked.size() < MAX_UNACKED || peer.suspected || !running; });
+            }
+            if (peer.unacked.size() >= MAX_UNACKED) {
+                throw std::runtime_error("UDP window to node " + std::to_string(destId) + " is full");
+            }
+        }
+        Header header = {DATA, {0, 0, 0}, id, epoch, peer.nextSeq++, peer.receiverEpoch};
+
+        Pending& pending = peer.unacked[header.seq];
+        pending.frame = messagePool().acquire();
+        pending.frame.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+        pending.frame += message;
+        pending.nextSend = std::chrono::steady_clock::now() + INITIAL_RTO;
+
+        sendFrame(destId, pending.frame);
+        retransmitNeeded.notify_one();
+    }
+
+    // Khong danh so thu tu, khong ACK, khong gui lai
+    void sendBestEffort(int destId, const std::string &message) override {
+        Header header = {UNRELIABLE, {0, 0, 0}, id, epoch, 0, 0};
+        std::string frame(reinterpret_cast<const char*>(&header), sizeof(header));
+        frame += message;
+        sendFrame(destId, frame);
+    }
+
+    void setSuspected(int nodeId, bool suspected) override {
+        {
+            std::lock_guard<std::mutex> lock(peersMutex);
+            Peer& peer = peers[nodeId];
+            peer.suspected = suspected;
+            if (!suspected) {
+                // Song lai: gui lai ngay cac tin nhan da giu
+                auto now = std::chrono::steady_clock::now();
+                for (auto& item : peer.unacked) {
+                    item.second.nextSend = now;
+                    item.second.attempts = 0;
+                }
+            }
+        }
+        retransmitNeeded.notify_one();
+        windowOpen.notify_all();
+    }
+
+private:
+    void sendFrame(int destId, const std::string& frame) {
+        sockaddr_in dest;
+        memset(&dest, 0, sizeof(dest));
+        dest.sin_family = AF_INET;
+        dest.sin_port = htons(config.getNodePort(destId));
+        dest.sin_addr = config.getNodeAddress(destId);
+
+        // Mat goi hoac loi tam thoi deu duoc luong gui lai xu ly
+        sendto(udpSocket, frame.data(), frame.size(), 0, (struct sockaddr*)&dest, sizeof(dest));
+    }
+
+    // Nut nhan bao epoch moi: danh so lai cac tin nhan chua duoc ACK tu 1 theo thu tu cu va gui lai.
+    // Goi khi dang giu peersMutex
+    void renumber(int destId, uint32_t receiverEpoch) {
+        Peer& peer = peers[destId];
+        if (peer.receiverEpoch == receiverEpoch) return;   // RESET lap lai cho tin nhan cu con tren duong
+        peer.receiverEpoch = receiverEpoch;
+
+        std::map<uint32_t, Pending> unacked;
+        peer.nextSeq = 1;
+        auto now = std::chrono::steady_clock::now();
+        for (auto& item : peer.unacked) {
+            Pending& pending = unacked[peer.nextSeq];
+            pending.frame = std::move(item.second.frame);
+            Header header = {DATA, {0, 0, 0}, id, epoch, peer.nextSeq++, receiverEpoch};
+            memcpy(&pending.frame[0], &header, sizeof(header));
+            pending.nextSend = now + INITIAL_RTO;
+            sendFrame(destId, pending.frame);
+        }
+        peer.unacked = std::move(unacked);
+        retransmitNeeded.notify_one();
+    }
+
+    void retransmit() {
+        std::unique_lock<std::mutex> lock(peersMutex);
+        while (running) {
+            auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+
+            for (auto& entry : peers) {
+                if (entry.second.suspected) continue;
+                for (auto& item : entry.second.unacked) {
+                    Pending& pending = item.second;
+                    if (pending.nextSend <= now) {
+                        pending.attempts++;
+                        if (pending.attempts == 10) {
+                            LOG_WARN("UDP message ", item.first, " to node ", entry.first, " still unacknowledged");
+                        }
+                        sendFrame(entry.first, pending.frame);
+                        pending.nextSend = now + std::min<std::chrono::milliseconds>(INITIAL_RTO * (1 << std::min(pending.attempts, 6)), MAX_RTO);
+                    }
+                    next = std::min(next, pending.nextSend);
+                }
+            }
+
+            if (next == std::chrono::steady_clock::time_point::max()) {
+                retransmitNeeded.wait(lock);
+            }
+            else {
+                retransmitNeeded.wait_until(lock, next);
+            }
+        }
+    }
+
+    void receive() {
+        pollfd fds[2] = {{wakeFd, POLLIN, 0}, {udpSocket, POLLIN, 0}};
+        std::string frame(MAX_DATAGRAM, '\0');
+
+        while (running) {
+            if (poll(fds, 2, -1) < 0 || !(fds[1].revents & POLLIN)) continue;
+
+            sockaddr_in src;
+            socklen_t srcLen = sizeof(src);
+            ssize_t n = recvfrom(udpSocket, &frame[0], frame.size(), 0, (struct sockaddr*)&src, &srcLen);
+            if (n < (ssize_t)sizeof(Header)) continue;
+
+            Header header;
+            memcpy(&header, frame.data(), sizeof(header));
+
+            if (header.kind == RESET) {
+                std::lock_guard<std::mutex> lock(peersMutex);
+                if (header.epoch == epoch) renumber(header.from, header.peerEpoch);
+                continue;
+            }
+            if (header.kind == ACK) {
+                std::lock_guard<std::mutex> lock(peersMutex);
+                if (header.epoch == epoch && header.peerEpoch == peers[header.from].receiverEpoch) {
+                    auto& unacked = peers[header.from].unacked;
+                    auto it = unacked.find(header.seq);
+                    if (it != unacked.end()) {
+                        messagePool().release(std::move(it->second.frame));
+                        unacked.erase(it);
+                        if (unacked.size() == MAX_UNACKED - 1) windowOpen.notify_all();
+                    }
+                }
+                continue;
+            }
+            if (header.kind == UNRELIABLE) {
+                deliver(messagePool().acquire(frame.data() + sizeof(Header), n - sizeof(Header)));
+                continue;
+            }
+
+            Source& source = sources[header.from];
+            if (source.epoch != header.epoch) {
+                // Nut gui vua khoi dong lai: bat dau lai tu dau
+                source = Source();
+                source.epoch = header.epoch;
+            }
+
+            if (header.peerEpoch != epoch) {
+                // Danh so cho lan chay khac cua nut nay: ACK co the trung so voi tin nhan da danh so lai.
+                // Sau khi da dong bo thi day chi la ban cu con tren duong, bo qua
+                if (!source.synced) {
+                    source = Source();
+                    source.epoch = header.epoch;
+                    Header reset = {RESET, {0, 0, 0}, id, header.epoch, 0, epoch};
+                    sendto(udpSocket, &reset, sizeof(reset), 0, (struct sockaddr*)&src, srcLen);
+                }
+                continue;
+            }
+            source.synced = true;
+
+            // ACK ca ban trung, vi ACK truoc do co the da bi mat
+            Header ack = {ACK, {0, 0, 0}, id, header.epoch, header.seq, epoch};
+            sendto(udpSocket, &ack, sizeof(ack), 0, (struct sockaddr*)&src, srcLen);
+
+            if (header.seq == source.expected) {
+                deliver(messagePool().acquire(frame.data() + sizeof(Header), n - sizeof(Header)));
+                source.expected++;
+                for (auto it = source.early.find(source.expected); it != source.early.end(); it = source.early.find(source.expected)) {
+                    deliver(std::move(it->second));
+                    source.early.erase(it);
+                    source.expected++;
+                }
+            }
+            else if (header.seq > source.expected) {
+                source.early.emplace(header.seq, frame.substr(sizeof(Header), n - sizeof(Header)));
+            }
+        }
+    }
+};
+
+#endif
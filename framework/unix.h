@@ -0,0 +1,40 @@
+#ifndef UNIX_H
+#define UNIX_H
+
+#include "stream.h"
+#include "config.h"
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <sys/un.h>
+
+extern Config config;
+
+// Unix domain socket cho cac nut tren cung may, dia chi nam trong abstract namespace
+// ("\0lamport_<port>") nen khong de lai file nao khi tien trinh ket thuc
+class UnixTransport : public StreamTransport {
+public:
+    UnixTransport(int id, Deliver deliver) : StreamTransport(deliver, config.useIoUring()) {
+        listen(id);
+    }
+
+    ~UnixTransport() {
+        shutdown();
+    }
+
+protected:
+    int domain() const override {
+        return AF_UNIX;
+    }
+
+    socklen_t address(int nodeId, sockaddr_storage& storage) const override {
+        std::string name = "lamport_" + std::to_string(config.getNodePort(nodeId));
+        sockaddr_un* addr = reinterpret_cast<sockaddr_un*>(&storage);
+        memset(addr, 0, sizeof(sockaddr_un));
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path + 1, name.data(), name.size());
+        return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+    }
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef URING_H
+#define URING_H
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Vong io_uring toi gian goi thang syscall (khong phu thuoc liburing).
+// Moi doi tuong chi duoc dung tu mot luong tai mot thoi diem.
+class IoUring {
+private:
+    int ringFd = -1;
+    io_uring_params params;
+    void* sqPtr = MAP_FAILED;
+    void* cqPtr = MAP_FAILED;
+    size_t sqSize = 0, cqSize = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe* cqes;
+    unsigned localTail = 0;         // Duoi hang doi gui da chuan bi, chua cong bo cho kernel
+    unsigned submittedTail = 0;
+
+public:
+    explicit IoUring(unsigned entries) {
+        memset(&params, 0, sizeof(params));
+        ringFd = syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0) {
+            throw std::runtime_error("io_uring is not available");
+        }
+
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+
+        sqPtr = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqPtr = single ? sqPtr : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe*)mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+        if (sqPtr == MAP_FAILED || cqPtr == MAP_FAILED || sqes == MAP_FAILED) {
+            release();
+            throw std::runtime_error("Failed to map io_uring");
+        }
+
+        char* sq = static_cast<char*>(sqPtr);
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+        localTail = submittedTail = *sqTail;
+
+        char* cq = static_cast<char*>(cqPtr);
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    }
+
+    ~IoUring() {
+        release();
+    }
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Tra ve nullptr neu hang doi gui da day (can submit truoc)
+    io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (localTail - head >= params.sq_entries) return nullptr;
+
+        unsigned index = localTail & *sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        localTail++;
+        return sqe;
+    }
+
+    // Gui tat ca SQE da chuan bi va doi it nhat waitNr CQE, chi mot syscall
+    int submitAndWait(unsigned waitNr) {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = localTail - submittedTail;
+
+        int ret;
+        do {
+            ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        } while (ret < 0 && errno == EINTR);
+
+        // Kernel dung lai o SQE loi dau tien; cac SQE con lai se duoc nop o lan goi sau
+        if (ret > 0) submittedTail += ret;
+        return ret;
+    }
+
+    // So SQE da chuan bi nhung kernel chua nhan (submitAndWait loi hoac moi nop duoc mot phan)
+    unsigned unsubmitted() const {
+        return localTail - submittedTail;
+    }
+
+    // Xu ly moi CQE dang co ma khong can syscall
+    template <typename F>
+    unsigned forEachCqe(F handle) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        while (head != tail) {
+            handle(cqes[head & *cqMask]);
+            head++;
+            count++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    bool registerBuffers(const iovec* iov, unsigned count) {
+        return syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    // Cap count vung dem lien tiep (moi vung size byte, id bat dau tu bid) cho nhom group.
+    // Chi chuan bi SQE, duoc nop cung lan submitAndWait tiep theo.
+    bool provideBuffers(char* base, unsigned size, unsigned count, unsigned short group, unsigned short bid, uint64_t userData) {
+        io_uring_sqe* sqe = getSqe();
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = count;
+        sqe->addr = (uint64_t)base;
+        sqe->len = size;
+        sqe->off = bid;
+        sqe->buf_group = group;
+        sqe->user_data = userData;
+        return true;
+    }
+
+private:
+    void release() {
+        if (sqes != MAP_FAILED) munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        if (cqPtr != MAP_FAILED && cqPtr != sqPtr) munmap(cqPtr, cqSize);
+        if (sqPtr != MAP_FAILED) munmap(sqPtr, sqSize);
+        if (ringFd >= 0) close(ringFd);
+        sqes = (io_uring_sqe*)MAP_FAILED;
+        sqPtr = cqPtr = MAP_FAILED;
+        ringFd = -1;
+    }
+};
+
+#endif